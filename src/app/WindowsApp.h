@@ -8,7 +8,7 @@
 #include <string>
 #include <vector>
 
-#include "vec3.h"
+#include "render_buffer.h"
 
 class WindowsApp final {
   private:
@@ -41,7 +41,7 @@ class WindowsApp final {
         return m_mouse_left_button_pressed;
     }
 
-    void updateScreenSurface(const std::vector<std::vector<color>> &canvas);
+    void updateScreenSurface(const RenderBuffer &canvas);
 
     static WindowsApp::ptr getInstance();
     static WindowsApp::ptr getInstance(int width, int height,
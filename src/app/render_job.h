@@ -0,0 +1,238 @@
+#ifndef RENDER_JOB_H
+#define RENDER_JOB_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "accelerator.h"
+#include "direct_light_integrator.h"
+#include "integrator.h"
+#include "mesh_cache.h"
+#include "mis_path_integrator.h"
+#include "path_integrator.h"
+#include "pbr_path_integrator.h"
+#include "render_buffer.h"
+#include "rr_path_integrator.h"
+#include "scenes.h"
+#include "tile_scheduler.h"
+#include "worker_pool.h"
+#include "trace.h"
+
+// Everything needed to describe one render, shared by the window front end
+// and the headless batch renderer.
+struct RenderJob {
+    int scene_id = 23;
+    int integrator_id = 4;            // 0: Path, 1: RR, 2: PBR, 3: NEE, 4: MIS
+    int samples_per_pixel = 0;        // 0: use the scene's own setting
+    int num_threads = 0;              // 0: one per available CPU
+    ThreadPlacement thread_placement = ThreadPlacement::kNone;
+    int tile_size = 16;               // pixels on a side
+    TileOrder tile_order = TileOrder::kScanline;
+    SamplerType sampler = SamplerType::kIndependent;
+    int max_depth = 50;
+    int samples_per_pass = 0;         // > 0: progressive passes of this spp
+    double time_budget_seconds = 0.0; // > 0: wall-clock limit, in seconds
+    double adaptive_threshold = 0.0;  // > 0: adaptive sampling target error
+    accelerator_type accelerator = default_accelerator();
+    bvh_build_options bvh_options = default_bvh_build_options();
+    simd_level simd = max_simd_level(); // widest BVH kernels to use
+    bool mesh_cache = mesh_cache_enabled(); // reuse <obj>.meshcache files
+    std::string output; // empty: output/sceneXX_integratorY_<time>.png
+    // Render statistics as JSON; empty: only printed
+    std::string stats_output;
+    // Chrome trace JSON of the whole run; empty: no tracing
+    std::string trace_output;
+    // Per-pixel time AOV next to the image: <output>_cost.png and .pfm
+    bool cost_heatmap = false;
+};
+
+// Integrator ids are 0 .. kIntegratorCount - 1
+constexpr int kIntegratorCount = 5;
+
+// nullptr for an id outside that range
+inline shared_ptr<Integrator> make_integrator(int integrator_id) {
+    switch (integrator_id) {
+    case 0:
+        return make_shared<PathIntegrator>();
+    case 1:
+        return make_shared<RRPathInterator>();
+    case 2:
+        return make_shared<PBRPathIntegrator>();
+    case 3:
+        return make_shared<DirectLightIntegrator>();
+    case 4:
+        return make_shared<MISPathIntegrator>();
+    default:
+        return nullptr;
+    }
+}
+
+// 生成带编号的文件名，并创建 output 文件夹（如果不存在）
+inline std::string default_output_path(const RenderJob &job) {
+    mkdir("output", 0755);
+
+    auto now = std::chrono::system_clock::now();
+    auto timestamp = std::chrono::system_clock::to_time_t(now);
+    std::stringstream filename;
+    filename << "output/scene" << std::setfill('0') << std::setw(2)
+             << job.scene_id << "_integrator" << job.integrator_id << "_"
+             << timestamp << ".png";
+    return filename.str();
+}
+
+// Picks the encoder from the file extension, PNG unless it ends in .jpg/.jpeg
+inline bool save_render_buffer(const RenderBuffer &buffer,
+                               const std::string &filename) {
+    trace_scope trace("encode_image", "io", trace_arg("file", filename));
+    auto ends_with = [&filename](const std::string &suffix) {
+        return filename.size() >= suffix.size() &&
+               filename.compare(filename.size() - suffix.size(),
+                                suffix.size(), suffix) == 0;
+    };
+    if (ends_with(".jpg") || ends_with(".jpeg")) {
+        return buffer.save_to_jpg(filename);
+    }
+    return buffer.save_to_png(filename);
+}
+
+// Parses "--flag value" style arguments into job. Returns false with a
+// message in error on unknown flags or malformed values.
+inline bool parse_render_job(int argc, char *argv[], RenderJob &job,
+                             std::string &error) {
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            error = "missing value for " + flag;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (flag == "--output" || flag == "-o") {
+            job.output = value;
+            continue;
+        }
+        if (flag == "--stats") {
+            job.stats_output = value;
+            continue;
+        }
+        if (flag == "--trace") {
+            job.trace_output = value;
+            continue;
+        }
+        if (flag == "--accel") {
+            if (!parse_accelerator(value, job.accelerator)) {
+                error = "unknown accelerator '" + value + "'";
+                return false;
+            }
+            continue;
+        }
+        if (flag == "--sampler") {
+            if (!parse_sampler(value, job.sampler)) {
+                error = "unknown sampler '" + value + "'";
+                return false;
+            }
+            continue;
+        }
+        if (flag == "--affinity") {
+            if (!parse_thread_placement(value, job.thread_placement)) {
+                error = "unknown thread placement '" + value + "'";
+                return false;
+            }
+            continue;
+        }
+        if (flag == "--tile-order") {
+            if (!parse_tile_order(value, job.tile_order)) {
+                error = "unknown tile order '" + value + "'";
+                return false;
+            }
+            continue;
+        }
+        if (flag == "--simd") {
+            if (!parse_simd_level(value, job.simd)) {
+                error = "unknown SIMD level '" + value + "'";
+                return false;
+            }
+            continue;
+        }
+        if (flag == "--mesh-cache") {
+            if (value != "on" && value != "off") {
+                error = "invalid value '" + value + "' for " + flag;
+                return false;
+            }
+            job.mesh_cache = value == "on";
+            continue;
+        }
+        if (flag == "--cost-heatmap") {
+            if (value != "on" && value != "off") {
+                error = "invalid value '" + value + "' for " + flag;
+                return false;
+            }
+            job.cost_heatmap = value == "on";
+            continue;
+        }
+
+        char *end = nullptr;
+        if (flag == "--time-budget" || flag == "--adaptive") {
+            double real = std::strtod(value.c_str(), &end);
+            if (end == value.c_str() || *end != '\0' || real < 0) {
+                error = "invalid value '" + value + "' for " + flag;
+                return false;
+            }
+            if (flag == "--time-budget") {
+                job.time_budget_seconds = real;
+            } else {
+                job.adaptive_threshold = real;
+            }
+            continue;
+        }
+
+        long number = std::strtol(value.c_str(), &end, 10);
+        if (end == value.c_str() || *end != '\0' || number < 0) {
+            error = "invalid value '" + value + "' for " + flag;
+            return false;
+        }
+
+        if (flag == "--scene" || flag == "-s") {
+            if (!is_valid_scene(static_cast<int>(number))) {
+                error = "unknown scene id " + value;
+                return false;
+            }
+            job.scene_id = static_cast<int>(number);
+        } else if (flag == "--integrator" || flag == "-i") {
+            if (number >= kIntegratorCount) {
+                error = "unknown integrator id " + value;
+                return false;
+            }
+            job.integrator_id = static_cast<int>(number);
+        } else if (flag == "--spp") {
+            job.samples_per_pixel = static_cast<int>(number);
+        } else if (flag == "--threads" || flag == "-t") {
+            job.num_threads = static_cast<int>(number);
+        } else if (flag == "--tile-size") {
+            job.tile_size = std::max(1, static_cast<int>(number));
+        } else if (flag == "--max-depth") {
+            job.max_depth = static_cast<int>(number);
+        } else if (flag == "--progressive") {
+            job.samples_per_pass = static_cast<int>(number);
+        } else if (flag == "--bvh-bins") {
+            job.bvh_options.bins = static_cast<int>(number);
+        } else if (flag == "--bvh-leaf-size") {
+            job.bvh_options.max_leaf_size = static_cast<int>(number);
+        } else if (flag == "--bvh-threads") {
+            job.bvh_options.num_threads = static_cast<int>(number);
+        } else {
+            error = "unknown option " + flag;
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
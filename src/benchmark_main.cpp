@@ -0,0 +1,358 @@
+// Benchmark: renders a fixed matrix of scenes x integrators at a fixed
+// resolution, spp and seed, prints rays per second for each run and writes
+// every measurement to a JSON file so builds can be compared.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <vector>
+
+#include "accelerator.h"
+#include "bvh_build.h"
+#include "camera.h"
+#include "cpu_topology.h"
+#include "cpu_features.h"
+#include "mesh_cache.h"
+#include "process_stats.h"
+#include "render_buffer.h"
+#include "render_job.h"
+#include "render_stats.h"
+#include "renderer.h"
+#include "scenes.h"
+
+namespace {
+
+enum ExitCode {
+    kExitSuccess = 0,
+    kExitFailed = 1,
+    kExitUsage = 2,
+};
+
+struct BenchmarkOptions {
+    std::vector<int> scenes{1, 23, 31, 43};
+    std::vector<int> integrators{0, 4}; // Path, MIS
+    int width = 320;                    // height follows the scene's aspect
+    int samples_per_pixel = 16;
+    int max_depth = 50;
+    int num_threads = 0; // 0: one per hardware thread
+    uint32_t seed = 1;
+    std::string output; // empty: output/benchmark_<time>.json
+};
+
+struct BenchmarkResult {
+    int scene_id = 0;
+    int integrator_id = 0;
+    int width = 0;
+    int height = 0;
+    int samples_per_pixel = 0;
+    double scene_seconds = 0.0;
+    double bvh_build_seconds = 0.0;
+    double render_seconds = 0.0;
+    long long primary_rays = 0;
+    long long secondary_rays = 0; // bounces and shadow rays
+    double peak_rss_mb = 0.0;     // of the whole process so far
+    RenderStats stats;
+};
+
+void print_usage(const char *program) {
+    std::cout
+        << "Usage: " << program << " [options]\n"
+        << "      --scenes <ids>      comma-separated scene ids (default "
+           "1,23,31,43)\n"
+        << "      --integrators <ids> comma-separated integrator ids "
+           "(default 0,4)\n"
+        << "      --width <n>         image width (default 320)\n"
+        << "      --spp <n>           samples per pixel (default 16)\n"
+        << "      --max-depth <n>     maximum path depth (default 50)\n"
+        << "  -t, --threads <n>       worker threads (default: all "
+           "hardware threads)\n"
+        << "      --seed <n>          scene and sampling seed (default 1)\n"
+        << "      --accel <type>      bvh, linear, bvh4 or bvh8 (default "
+           "linear)\n"
+        << "      --simd <level>      scalar, sse or avx (default: best the "
+           "CPU has)\n"
+        << "  -o, --output <file>     JSON output path (default: "
+           "output/benchmark_<time>.json)\n"
+        << "OBJ mesh caches are ignored so BVH build times are real.\n";
+}
+
+bool parse_id_list(const std::string &value, std::vector<int> &ids) {
+    ids.clear();
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char *end = nullptr;
+        long id = std::strtol(item.c_str(), &end, 10);
+        if (end == item.c_str() || *end != '\0' || id < 0) {
+            return false;
+        }
+        ids.push_back(static_cast<int>(id));
+    }
+    return !ids.empty();
+}
+
+bool parse_options(int argc, char *argv[], BenchmarkOptions &options,
+                   accelerator_type &accelerator, simd_level &simd,
+                   std::string &error) {
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            error = "missing value for " + flag;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (flag == "--output" || flag == "-o") {
+            options.output = value;
+            continue;
+        }
+        if (flag == "--scenes" || flag == "--integrators") {
+            if (!parse_id_list(value, flag == "--scenes"
+                                          ? options.scenes
+                                          : options.integrators)) {
+                error = "invalid value '" + value + "' for " + flag;
+                return false;
+            }
+            if (flag == "--scenes") {
+                for (int id : options.scenes) {
+                    if (!is_valid_scene(id)) {
+                        error = "unknown scene id " + std::to_string(id);
+                        return false;
+                    }
+                }
+            } else {
+                for (int id : options.integrators) {
+                    if (id >= kIntegratorCount) {
+                        error = "unknown integrator id " + std::to_string(id);
+                        return false;
+                    }
+                }
+            }
+            continue;
+        }
+        if (flag == "--accel") {
+            if (!parse_accelerator(value, accelerator)) {
+                error = "unknown accelerator '" + value + "'";
+                return false;
+            }
+            continue;
+        }
+        if (flag == "--simd") {
+            if (!parse_simd_level(value, simd)) {
+                error = "unknown SIMD level '" + value + "'";
+                return false;
+            }
+            continue;
+        }
+
+        char *end = nullptr;
+        long number = std::strtol(value.c_str(), &end, 10);
+        if (end == value.c_str() || *end != '\0' || number < 0) {
+            error = "invalid value '" + value + "' for " + flag;
+            return false;
+        }
+        if (flag == "--width") {
+            options.width = static_cast<int>(number);
+        } else if (flag == "--spp") {
+            options.samples_per_pixel = static_cast<int>(number);
+        } else if (flag == "--max-depth") {
+            options.max_depth = static_cast<int>(number);
+        } else if (flag == "--threads" || flag == "-t") {
+            options.num_threads = static_cast<int>(number);
+        } else if (flag == "--seed") {
+            options.seed = static_cast<uint32_t>(number);
+        } else {
+            error = "unknown option " + flag;
+            return false;
+        }
+    }
+    if (options.width < 1 || options.samples_per_pixel < 1) {
+        error = "--width and --spp must be at least 1";
+        return false;
+    }
+    return true;
+}
+
+// Builds the scene and renders it once
+void run_benchmark(const BenchmarkOptions &options, int scene_id,
+                   int integrator_id, BenchmarkResult &result) {
+    result.scene_id = scene_id;
+    result.integrator_id = integrator_id;
+
+    // Same random numbers for the scene every run
+    seed_random(options.seed);
+    bvh_build_nanoseconds() = 0;
+    auto scene_start = std::chrono::steady_clock::now();
+    SceneConfig config = select_scene(scene_id);
+    std::chrono::duration<double> scene_time =
+        std::chrono::steady_clock::now() - scene_start;
+    result.scene_seconds = scene_time.count();
+    result.bvh_build_seconds = bvh_build_seconds();
+
+    auto cam = make_shared<camera>(config.lookfrom, config.lookat, config.vup,
+                                   config.vfov, config.aspect_ratio,
+                                   config.aperture, config.focus_dist, 0.0,
+                                   1.0);
+    result.width = options.width;
+    result.height =
+        std::max(1, static_cast<int>(options.width / config.aspect_ratio));
+    result.samples_per_pixel = options.samples_per_pixel;
+    RenderBuffer render_buffer(result.width, result.height);
+
+    Renderer renderer;
+    renderer.set_samples(options.samples_per_pixel);
+    renderer.set_threads(options.num_threads);
+    renderer.set_seed(options.seed);
+    renderer.set_integrator(make_integrator(integrator_id));
+    renderer.set_max_depth(options.max_depth);
+
+    auto render_start = std::chrono::steady_clock::now();
+    renderer.render(config.world, cam, config.background, render_buffer,
+                    config.lights);
+    std::chrono::duration<double> render_time =
+        std::chrono::steady_clock::now() - render_start;
+    result.render_seconds = render_time.count();
+
+    // Secondary rays need the render statistics (RT_ENABLE_STATS)
+    result.stats = renderer.stats();
+    result.primary_rays = static_cast<long long>(result.width) *
+                          result.height * options.samples_per_pixel;
+    result.secondary_rays = result.stats.counters[kBounceRays] +
+                            result.stats.counters[kShadowRays];
+    result.peak_rss_mb = bytes_to_mb(peak_rss_bytes());
+}
+
+double per_second(long long count, double seconds) {
+    return seconds > 0 ? count / seconds : 0.0;
+}
+
+std::string default_benchmark_path() {
+    mkdir("output", 0755);
+    std::stringstream filename;
+    filename << "output/benchmark_" << std::time(nullptr) << ".json";
+    return filename.str();
+}
+
+bool write_json(const std::string &filename, const BenchmarkOptions &options,
+                const std::vector<BenchmarkResult> &results) {
+    std::ofstream out(filename);
+    if (!out) {
+        return false;
+    }
+    const int threads =
+        options.num_threads > 0 ? options.num_threads : available_cpu_count();
+    const char *accelerator_names[] = {"bvh", "linear", "bvh4", "bvh8"};
+
+    out << std::setprecision(9);
+    out << "{\n"
+        << "  \"timestamp\": " << std::time(nullptr) << ",\n"
+        << "  \"threads\": " << threads << ",\n"
+        << "  \"accelerator\": \""
+        << accelerator_names[static_cast<int>(default_accelerator())]
+        << "\",\n"
+        << "  \"simd\": \"" << simd_level_name(max_simd_level()) << "\",\n"
+        << "  \"seed\": " << options.seed << ",\n"
+        << "  \"max_depth\": " << options.max_depth << ",\n"
+        << "  \"runs\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult &r = results[i];
+        const long long rays = r.primary_rays + r.secondary_rays;
+        out << (i == 0 ? "\n" : ",\n") << "    {\n"
+            << "      \"scene\": " << r.scene_id << ",\n"
+            << "      \"integrator\": " << r.integrator_id << ",\n"
+            << "      \"width\": " << r.width << ",\n"
+            << "      \"height\": " << r.height << ",\n"
+            << "      \"spp\": " << r.samples_per_pixel << ",\n"
+            << "      \"scene_seconds\": " << r.scene_seconds << ",\n"
+            << "      \"bvh_build_seconds\": " << r.bvh_build_seconds << ",\n"
+            << "      \"render_seconds\": " << r.render_seconds << ",\n"
+            << "      \"primary_rays\": " << r.primary_rays << ",\n"
+            << "      \"secondary_rays\": " << r.secondary_rays << ",\n"
+            << "      \"primary_rays_per_second\": "
+            << per_second(r.primary_rays, r.render_seconds) << ",\n"
+            << "      \"secondary_rays_per_second\": "
+            << per_second(r.secondary_rays, r.render_seconds) << ",\n"
+            << "      \"rays_per_second\": "
+            << per_second(rays, r.render_seconds) << ",\n"
+            << "      \"shadow_rays\": " << r.stats.counters[kShadowRays]
+            << ",\n"
+            << "      \"bvh_nodes_per_ray\": "
+            << r.stats.per_ray(kBvhNodesVisited) << ",\n"
+            << "      \"primitive_tests_per_ray\": "
+            << r.stats.per_ray(kPrimitiveTests) << ",\n"
+            << "      \"average_path_length\": "
+            << r.stats.average_path_length() << ",\n"
+            << "      \"peak_rss_mb\": " << r.peak_rss_mb << "\n"
+            << "    }";
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return kExitSuccess;
+        }
+    }
+
+    BenchmarkOptions options;
+    accelerator_type accelerator = default_accelerator();
+    simd_level simd = max_simd_level();
+    std::string error;
+    if (!parse_options(argc, argv, options, accelerator, simd, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        print_usage(argv[0]);
+        return kExitUsage;
+    }
+    set_default_accelerator(accelerator);
+    set_max_simd_level(simd);
+    mesh_cache_enabled() = false;
+
+    std::vector<BenchmarkResult> results;
+    for (int scene_id : options.scenes) {
+        for (int integrator_id : options.integrators) {
+            std::cout << "== scene " << scene_id << ", integrator "
+                      << integrator_id << std::endl;
+            BenchmarkResult result;
+            run_benchmark(options, scene_id, integrator_id, result);
+            results.push_back(result);
+        }
+    }
+
+    std::cout << "\n scene integ   render s   bvh s  primary Mray/s"
+                 "  secondary Mray/s  peak MB\n";
+    for (const BenchmarkResult &r : results) {
+        std::cout << std::fixed << std::setprecision(3) << std::setw(6)
+                  << r.scene_id << std::setw(6) << r.integrator_id
+                  << std::setw(11) << r.render_seconds << std::setw(8)
+                  << r.bvh_build_seconds << std::setw(16)
+                  << per_second(r.primary_rays, r.render_seconds) * 1e-6
+                  << std::setw(18)
+                  << per_second(r.secondary_rays, r.render_seconds) * 1e-6
+                  << std::setw(9) << std::setprecision(1) << r.peak_rss_mb
+                  << "\n";
+    }
+
+    std::string output_file =
+        options.output.empty() ? default_benchmark_path() : options.output;
+    if (!write_json(output_file, options, results)) {
+        std::cerr << "Failed to write " << output_file << std::endl;
+        return kExitFailed;
+    }
+    std::cout << "Results written to " << output_file << std::endl;
+    return kExitSuccess;
+}
@@ -0,0 +1,398 @@
+// Convergence: renders each scene once at a high spp as the reference, then
+// at a ladder of spp with every sampler, and reports the RMSE against the
+// reference. For the low-discrepancy samplers it also reports the spp the
+// independent sampler needs for the same error.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <vector>
+
+#include "camera.h"
+#include "render_buffer.h"
+#include "render_job.h"
+#include "renderer.h"
+#include "sampler.h"
+#include "scenes.h"
+
+namespace {
+
+enum ExitCode {
+    kExitSuccess = 0,
+    kExitFailed = 1,
+    kExitUsage = 2,
+};
+
+struct ConvergenceOptions {
+    std::vector<int> scenes{21, 37}; // Cornell box NEE, PBR spheres
+    int integrator_id = 4;           // MIS
+    int width = 128;
+    int reference_spp = 1024;
+    std::vector<int> spp{1, 2, 4, 8, 16, 32, 64};
+    std::vector<SamplerType> samplers{
+        SamplerType::kIndependent, SamplerType::kSobol,
+        SamplerType::kHalton, SamplerType::kBlueNoise};
+    int max_depth = 50;
+    int num_threads = 0;
+    uint32_t seed = 1;
+    std::string output; // empty: output/convergence_<time>.json
+};
+
+// Error of one sampler at one spp
+struct ConvergencePoint {
+    SamplerType sampler = SamplerType::kIndependent;
+    int samples_per_pixel = 0;
+    double rmse = 0.0;
+    double render_seconds = 0.0;
+    double equivalent_spp = 0.0; // independent spp with the same RMSE
+};
+
+struct SceneConvergence {
+    int scene_id = 0;
+    int width = 0;
+    int height = 0;
+    double reference_seconds = 0.0;
+    std::vector<ConvergencePoint> points;
+};
+
+void print_usage(const char *program) {
+    std::cout
+        << "Usage: " << program << " [options]\n"
+        << "      --scenes <ids>        comma-separated scene ids (default "
+           "21,37)\n"
+        << "      --integrator <id>     integrator id (default 4)\n"
+        << "      --width <n>           image width (default 128)\n"
+        << "      --reference-spp <n>   spp of the reference (default 1024)\n"
+        << "      --spp <list>          comma-separated spp ladder (default "
+           "1,2,4,...,64)\n"
+        << "      --samplers <names>    comma-separated samplers (default "
+           "independent,sobol,halton,bluenoise)\n"
+        << "      --max-depth <n>       maximum path depth (default 50)\n"
+        << "  -t, --threads <n>         worker threads (default: all "
+           "hardware threads)\n"
+        << "      --seed <n>            scene and sampling seed (default 1)\n"
+        << "  -o, --output <file>       JSON output path (default: "
+           "output/convergence_<time>.json)\n"
+        << "The reference uses the independent sampler with another seed.\n";
+}
+
+bool parse_number_list(const std::string &value, std::vector<int> &numbers,
+                       int minimum) {
+    numbers.clear();
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char *end = nullptr;
+        long number = std::strtol(item.c_str(), &end, 10);
+        if (end == item.c_str() || *end != '\0' || number < minimum) {
+            return false;
+        }
+        numbers.push_back(static_cast<int>(number));
+    }
+    return !numbers.empty();
+}
+
+bool parse_sampler_list(const std::string &value,
+                        std::vector<SamplerType> &samplers) {
+    samplers.clear();
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        SamplerType sampler;
+        if (!parse_sampler(item, sampler)) {
+            return false;
+        }
+        samplers.push_back(sampler);
+    }
+    return !samplers.empty();
+}
+
+bool parse_options(int argc, char *argv[], ConvergenceOptions &options,
+                   std::string &error) {
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            error = "missing value for " + flag;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        bool ok = true;
+        if (flag == "--output" || flag == "-o") {
+            options.output = value;
+            continue;
+        } else if (flag == "--scenes") {
+            ok = parse_number_list(value, options.scenes, 0);
+            for (size_t j = 0; ok && j < options.scenes.size(); ++j) {
+                if (!is_valid_scene(options.scenes[j])) {
+                    error = "unknown scene id " +
+                            std::to_string(options.scenes[j]);
+                    return false;
+                }
+            }
+        } else if (flag == "--spp") {
+            ok = parse_number_list(value, options.spp, 1);
+        } else if (flag == "--samplers") {
+            ok = parse_sampler_list(value, options.samplers);
+        } else {
+            char *end = nullptr;
+            long number = std::strtol(value.c_str(), &end, 10);
+            ok = end != value.c_str() && *end == '\0' && number >= 0;
+            if (flag == "--integrator") {
+                ok = ok && number < kIntegratorCount;
+                options.integrator_id = static_cast<int>(number);
+            } else if (flag == "--width") {
+                options.width = static_cast<int>(number);
+            } else if (flag == "--reference-spp") {
+                options.reference_spp = static_cast<int>(number);
+            } else if (flag == "--max-depth") {
+                options.max_depth = static_cast<int>(number);
+            } else if (flag == "--threads" || flag == "-t") {
+                options.num_threads = static_cast<int>(number);
+            } else if (flag == "--seed") {
+                options.seed = static_cast<uint32_t>(number);
+            } else {
+                error = "unknown option " + flag;
+                return false;
+            }
+        }
+        if (!ok) {
+            error = "invalid value '" + value + "' for " + flag;
+            return false;
+        }
+    }
+    if (options.width < 1 || options.reference_spp < 1) {
+        error = "--width and --reference-spp must be at least 1";
+        return false;
+    }
+    return true;
+}
+
+double render_once(const ConvergenceOptions &options,
+                   const SceneConfig &config,
+                   const shared_ptr<camera> &cam, int samples_per_pixel,
+                   SamplerType sampler, uint32_t seed,
+                   RenderBuffer &buffer) {
+    Renderer renderer;
+    renderer.set_samples(samples_per_pixel);
+    renderer.set_threads(options.num_threads);
+    renderer.set_seed(seed);
+    renderer.set_sampler(sampler);
+    renderer.set_integrator(make_integrator(options.integrator_id));
+    renderer.set_max_depth(options.max_depth);
+
+    auto start = std::chrono::steady_clock::now();
+    renderer.render(config.world, cam, config.background, buffer,
+                    config.lights);
+    std::chrono::duration<double> seconds =
+        std::chrono::steady_clock::now() - start;
+    return seconds.count();
+}
+
+// Over the displayed colour channels
+double rmse(const RenderBuffer &image, const RenderBuffer &reference) {
+    double sum = 0.0;
+    for (int y = 0; y < image.height(); y++) {
+        for (int x = 0; x < image.width(); x++) {
+            color d = image.get_pixel(x, y) - reference.get_pixel(x, y);
+            sum += d.x() * d.x() + d.y() * d.y() + d.z() * d.z();
+        }
+    }
+    return std::sqrt(sum / (3.0 * image.width() * image.height()));
+}
+
+// spp at which the independent sampler reaches `error`: log-log
+// interpolation along its curve, extrapolated past the ends with its
+// expected 1/sqrt(spp) falloff
+double equivalent_spp(const std::vector<ConvergencePoint> &independent,
+                      double error) {
+    if (independent.empty() || error <= 0.0) {
+        return 0.0;
+    }
+    auto extrapolate = [error](const ConvergencePoint &p) {
+        double ratio = p.rmse / error;
+        return p.samples_per_pixel * ratio * ratio;
+    };
+    if (error >= independent.front().rmse) {
+        return extrapolate(independent.front());
+    }
+    for (size_t k = 1; k < independent.size(); k++) {
+        const ConvergencePoint &a = independent[k - 1];
+        const ConvergencePoint &b = independent[k];
+        if (error >= b.rmse) {
+            double t = std::log(a.rmse / error) / std::log(a.rmse / b.rmse);
+            return std::exp(std::log(double(a.samples_per_pixel)) +
+                            t * std::log(double(b.samples_per_pixel) /
+                                         a.samples_per_pixel));
+        }
+    }
+    return extrapolate(independent.back());
+}
+
+// Builds the scene and runs every sampler along the ladder
+void run_scene(const ConvergenceOptions &options, int scene_id,
+               SceneConvergence &result) {
+    result.scene_id = scene_id;
+    seed_random(options.seed);
+    SceneConfig config = select_scene(scene_id);
+    auto cam = make_shared<camera>(config.lookfrom, config.lookat, config.vup,
+                                   config.vfov, config.aspect_ratio,
+                                   config.aperture, config.focus_dist, 0.0,
+                                   1.0);
+    result.width = options.width;
+    result.height =
+        std::max(1, static_cast<int>(options.width / config.aspect_ratio));
+
+    RenderBuffer reference(result.width, result.height);
+    std::cout << "   reference: " << options.reference_spp << " spp"
+              << std::flush;
+    result.reference_seconds = render_once(
+        options, config, cam, options.reference_spp,
+        SamplerType::kIndependent, options.seed ^ 0x5bd1e995u, reference);
+    std::cout << ", " << std::fixed << std::setprecision(1)
+              << result.reference_seconds << " s" << std::endl;
+
+    RenderBuffer image(result.width, result.height);
+    for (SamplerType sampler : options.samplers) {
+        for (int spp : options.spp) {
+            ConvergencePoint point;
+            point.sampler = sampler;
+            point.samples_per_pixel = spp;
+            point.render_seconds = render_once(options, config, cam, spp,
+                                               sampler, options.seed, image);
+            point.rmse = rmse(image, reference);
+            result.points.push_back(point);
+        }
+    }
+
+    std::vector<ConvergencePoint> independent;
+    for (const ConvergencePoint &p : result.points) {
+        if (p.sampler == SamplerType::kIndependent) {
+            independent.push_back(p);
+        }
+    }
+    for (ConvergencePoint &p : result.points) {
+        p.equivalent_spp = p.sampler == SamplerType::kIndependent
+                               ? p.samples_per_pixel
+                               : equivalent_spp(independent, p.rmse);
+    }
+}
+
+void print_scene(const ConvergenceOptions &options,
+                 const SceneConvergence &scene) {
+    std::cout << "\n   spp";
+    for (SamplerType sampler : options.samplers) {
+        std::cout << std::setw(22) << sampler_name(sampler);
+    }
+    std::cout << "\n";
+    for (size_t k = 0; k < options.spp.size(); k++) {
+        std::cout << std::setw(6) << options.spp[k];
+        for (size_t s = 0; s < options.samplers.size(); s++) {
+            const ConvergencePoint &p =
+                scene.points[s * options.spp.size() + k];
+            // RMSE (independent spp for the same RMSE)
+            std::ostringstream cell;
+            cell << std::fixed << std::setprecision(5) << p.rmse << " ("
+                 << std::setprecision(1) << p.equivalent_spp << ")";
+            std::cout << std::setw(22) << cell.str();
+        }
+        std::cout << "\n";
+    }
+}
+
+std::string default_convergence_path() {
+    mkdir("output", 0755);
+    std::stringstream filename;
+    filename << "output/convergence_" << std::time(nullptr) << ".json";
+    return filename.str();
+}
+
+bool write_json(const std::string &filename,
+                const ConvergenceOptions &options,
+                const std::vector<SceneConvergence> &scenes) {
+    std::ofstream out(filename);
+    if (!out) {
+        return false;
+    }
+    out << std::setprecision(9);
+    out << "{\n"
+        << "  \"timestamp\": " << std::time(nullptr) << ",\n"
+        << "  \"integrator\": " << options.integrator_id << ",\n"
+        << "  \"seed\": " << options.seed << ",\n"
+        << "  \"max_depth\": " << options.max_depth << ",\n"
+        << "  \"reference_spp\": " << options.reference_spp << ",\n"
+        << "  \"scenes\": [";
+    for (size_t i = 0; i < scenes.size(); ++i) {
+        const SceneConvergence &scene = scenes[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\n"
+            << "      \"scene\": " << scene.scene_id << ",\n"
+            << "      \"width\": " << scene.width << ",\n"
+            << "      \"height\": " << scene.height << ",\n"
+            << "      \"reference_seconds\": " << scene.reference_seconds
+            << ",\n"
+            << "      \"points\": [";
+        for (size_t k = 0; k < scene.points.size(); ++k) {
+            const ConvergencePoint &p = scene.points[k];
+            out << (k == 0 ? "\n" : ",\n") << "        {\"sampler\": \""
+                << sampler_name(p.sampler)
+                << "\", \"spp\": " << p.samples_per_pixel
+                << ", \"rmse\": " << p.rmse
+                << ", \"equivalent_spp\": " << p.equivalent_spp
+                << ", \"render_seconds\": " << p.render_seconds << "}";
+        }
+        out << "\n      ]\n    }";
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return kExitSuccess;
+        }
+    }
+
+    ConvergenceOptions options;
+    std::string error;
+    if (!parse_options(argc, argv, options, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        print_usage(argv[0]);
+        return kExitUsage;
+    }
+
+    std::vector<SceneConvergence> scenes;
+    for (int scene_id : options.scenes) {
+        std::cout << "== scene " << scene_id << ", integrator "
+                  << options.integrator_id << std::endl;
+        SceneConvergence scene;
+        run_scene(options, scene_id, scene);
+        print_scene(options, scene);
+        scenes.push_back(scene);
+    }
+
+    std::string output_file = options.output.empty()
+                                  ? default_convergence_path()
+                                  : options.output;
+    if (!write_json(output_file, options, scenes)) {
+        std::cerr << "Failed to write " << output_file << std::endl;
+        return kExitFailed;
+    }
+    std::cout << "Results written to " << output_file << std::endl;
+    return kExitSuccess;
+}
@@ -0,0 +1,118 @@
+#ifndef ALIGNED_ARRAY_H
+#define ALIGNED_ARRAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Fixed-size heap array whose first element starts on an Alignment-byte
+// boundary (a cache line by default). Elements are zero-initialised.
+template <typename T, size_t Alignment = 64> class aligned_array {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "aligned_array only holds trivially copyable types");
+    static_assert((Alignment & (Alignment - 1)) == 0,
+                  "Alignment must be a power of two");
+
+  public:
+    aligned_array() = default;
+    explicit aligned_array(size_t count) {
+        resize(count);
+    }
+    ~aligned_array() {
+        release();
+    }
+
+    aligned_array(const aligned_array &) = delete;
+    aligned_array &operator=(const aligned_array &) = delete;
+
+    aligned_array(aligned_array &&other) noexcept
+        : m_raw(other.m_raw), m_data(other.m_data), m_size(other.m_size) {
+        other.m_raw = nullptr;
+        other.m_data = nullptr;
+        other.m_size = 0;
+    }
+    aligned_array &operator=(aligned_array &&other) noexcept {
+        if (this != &other) {
+            release();
+            std::swap(m_raw, other.m_raw);
+            std::swap(m_data, other.m_data);
+            std::swap(m_size, other.m_size);
+        }
+        return *this;
+    }
+
+    // Discards the old contents
+    void resize(size_t count) {
+        release();
+        if (count == 0) {
+            return;
+        }
+        size_t bytes = count * sizeof(T);
+        m_raw = std::malloc(bytes + Alignment - 1);
+        if (!m_raw) {
+            throw std::bad_alloc();
+        }
+        auto address = reinterpret_cast<std::uintptr_t>(m_raw);
+        address = (address + Alignment - 1) & ~(std::uintptr_t(Alignment) - 1);
+        m_data = reinterpret_cast<T *>(address);
+        m_size = count;
+        std::memset(static_cast<void *>(m_data), 0, bytes);
+    }
+
+    void fill(const T &value) {
+        for (size_t i = 0; i < m_size; ++i) {
+            m_data[i] = value;
+        }
+    }
+
+    T *data() noexcept {
+        return m_data;
+    }
+    const T *data() const noexcept {
+        return m_data;
+    }
+    size_t size() const noexcept {
+        return m_size;
+    }
+    bool empty() const noexcept {
+        return m_size == 0;
+    }
+
+    T &operator[](size_t i) noexcept {
+        return m_data[i];
+    }
+    const T &operator[](size_t i) const noexcept {
+        return m_data[i];
+    }
+
+    T *begin() noexcept {
+        return m_data;
+    }
+    T *end() noexcept {
+        return m_data + m_size;
+    }
+    const T *begin() const noexcept {
+        return m_data;
+    }
+    const T *end() const noexcept {
+        return m_data + m_size;
+    }
+
+  private:
+    void release() {
+        std::free(m_raw);
+        m_raw = nullptr;
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    void *m_raw = nullptr;
+    T *m_data = nullptr;
+    size_t m_size = 0;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||          \
+    defined(_M_IX86)
+#define RT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX instructions inside functions that ask for
+// them, so the AVX kernels can live next to the baseline code and be
+// picked at run time. MSVC accepts the intrinsics anywhere.
+#if defined(RT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define RT_TARGET_AVX __attribute__((target("avx")))
+#else
+#define RT_TARGET_AVX
+#endif
+
+// Widest vector instruction set the traversal kernels may use
+enum class simd_level {
+    scalar,
+    sse, // 4-wide float; always there on x86-64
+    avx, // 8-wide float
+};
+
+inline simd_level detect_simd_level() {
+#if defined(RT_X86)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool avx = (info[2] & (1 << 28)) != 0;     // CPU has AVX
+    bool osxsave = (info[2] & (1 << 27)) != 0; // OS uses XSAVE
+    // ...and saves the YMM registers on context switches
+    if (avx && osxsave && (_xgetbv(0) & 0x6) == 0x6) {
+        return simd_level::avx;
+    }
+    return simd_level::sse;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx")) {
+        return simd_level::avx;
+    }
+    return simd_level::sse;
+#endif
+#else
+    return simd_level::scalar;
+#endif
+}
+
+// Level used by new acceleration structures: what the CPU supports, unless
+// lowered with set_max_simd_level() (e.g. to compare against scalar code)
+inline simd_level &max_simd_level() {
+    static simd_level level = detect_simd_level();
+    return level;
+}
+
+inline void set_max_simd_level(simd_level level) {
+    if (level < detect_simd_level()) {
+        max_simd_level() = level;
+    } else {
+        max_simd_level() = detect_simd_level();
+    }
+}
+
+inline const char *simd_level_name(simd_level level) {
+    switch (level) {
+    case simd_level::avx:
+        return "avx";
+    case simd_level::sse:
+        return "sse";
+    case simd_level::scalar:
+    default:
+        return "scalar";
+    }
+}
+
+// "scalar", "sse" or "avx"; returns false for anything else
+inline bool parse_simd_level(const std::string &name, simd_level &level) {
+    if (name == "scalar") {
+        level = simd_level::scalar;
+    } else if (name == "sse") {
+        level = simd_level::sse;
+    } else if (name == "avx") {
+        level = simd_level::avx;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+namespace cpu_topology_detail {
+
+inline std::vector<std::vector<int>> read_cpu_nodes() {
+    std::vector<int> allowed;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                allowed.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (allowed.empty()) {
+        int count = static_cast<int>(
+            std::max(1u, std::thread::hardware_concurrency()));
+        for (int cpu = 0; cpu < count; cpu++) {
+            allowed.push_back(cpu);
+        }
+    }
+
+    std::vector<std::vector<int>> nodes;
+    std::vector<bool> placed(allowed.back() + 1, false);
+#if defined(__linux__)
+    // cpulist reads like "0-7,16-23"
+    for (int node = 0;; node++) {
+        std::string path = "/sys/devices/system/node/node" +
+                           std::to_string(node) + "/cpulist";
+        FILE *file = std::fopen(path.c_str(), "r");
+        if (!file) {
+            break;
+        }
+        std::vector<int> cpus;
+        int first, last;
+        while (std::fscanf(file, "%d", &first) == 1) {
+            last = first;
+            int c = std::fgetc(file);
+            if (c == '-') {
+                if (std::fscanf(file, "%d", &last) != 1) {
+                    break;
+                }
+                c = std::fgetc(file);
+            }
+            for (int cpu = first; cpu <= last; cpu++) {
+                if (std::binary_search(allowed.begin(), allowed.end(), cpu)) {
+                    cpus.push_back(cpu);
+                    placed[cpu] = true;
+                }
+            }
+            if (c != ',') {
+                break;
+            }
+        }
+        std::fclose(file);
+        if (!cpus.empty()) {
+            nodes.push_back(cpus);
+        }
+    }
+#endif
+    if (nodes.empty()) {
+        nodes.emplace_back();
+    }
+    for (int cpu : allowed) {
+        if (!placed[cpu]) {
+            nodes[0].push_back(cpu);
+        }
+    }
+    std::sort(nodes[0].begin(), nodes[0].end());
+    return nodes;
+}
+
+} // namespace cpu_topology_detail
+
+// Logical CPUs this process may run on, grouped by NUMA node. On Linux the
+// affinity mask set by taskset or a cgroup cpuset is honoured; where nodes
+// cannot be read every CPU is in node 0. Read on the first call and kept,
+// so renders do not go back to sysfs for every pass; that first call must
+// come from a thread that has not been pinned.
+inline const std::vector<std::vector<int>> &cpu_nodes() {
+    static const std::vector<std::vector<int>> nodes =
+        cpu_topology_detail::read_cpu_nodes();
+    return nodes;
+}
+
+inline int available_cpu_count() {
+    int count = 0;
+    for (const auto &node : cpu_nodes()) {
+        count += static_cast<int>(node.size());
+    }
+    return count;
+}
+
+// Restricts the calling thread to one logical CPU. Returns false where
+// that is not supported or the CPU is not available.
+inline bool pin_current_thread(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    if (cpu >= 64) {
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) !=
+           0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file through the OS page cache. Pages are read
+// on first touch and never copied into the process heap.
+class mapped_file {
+  public:
+    mapped_file() = default;
+    explicit mapped_file(const std::string &path) {
+        open(path);
+    }
+    ~mapped_file() {
+        close();
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    mapped_file(mapped_file &&other) noexcept {
+        swap(other);
+    }
+    mapped_file &operator=(mapped_file &&other) noexcept {
+        if (this != &other) {
+            close();
+            swap(other);
+        }
+        return *this;
+    }
+
+    // Maps path, replacing any previous mapping. An empty file opens
+    // successfully with size() == 0 and data() == nullptr. sequential tells
+    // the OS to read ahead (parsers); pass false for random access.
+    bool open(const std::string &path, bool sequential = true);
+    void close();
+
+    bool is_open() const {
+        return m_open;
+    }
+    const char *data() const {
+        return m_data;
+    }
+    size_t size() const {
+        return m_size;
+    }
+
+  private:
+    void swap(mapped_file &other) {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_open, other.m_open);
+#ifdef _WIN32
+        std::swap(m_file, other.m_file);
+        std::swap(m_mapping, other.m_mapping);
+#endif
+    }
+
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_open = false;
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+};
+
+#ifdef _WIN32
+
+inline bool mapped_file::open(const std::string &path, bool sequential) {
+    close();
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                         OPEN_EXISTING,
+                         sequential ? FILE_FLAG_SEQUENTIAL_SCAN
+                                    : FILE_FLAG_RANDOM_ACCESS,
+                         nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size)) {
+        close();
+        return false;
+    }
+    m_open = true;
+    m_size = static_cast<size_t>(size.QuadPart);
+    if (m_size == 0) {
+        return true;
+    }
+    m_mapping =
+        CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        close();
+        return false;
+    }
+    m_data = static_cast<const char *>(
+        MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+inline void mapped_file::close() {
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+    }
+    if (m_mapping) {
+        CloseHandle(m_mapping);
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+    }
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_file = INVALID_HANDLE_VALUE;
+    m_size = 0;
+    m_open = false;
+}
+
+#else
+
+inline bool mapped_file::open(const std::string &path, bool sequential) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+    m_size = static_cast<size_t>(info.st_size);
+    if (m_size > 0) {
+        void *address = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            ::close(fd);
+            m_size = 0;
+            return false;
+        }
+        madvise(address, m_size,
+                sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        m_data = static_cast<const char *>(address);
+    }
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    m_open = true;
+    return true;
+}
+
+inline void mapped_file::close() {
+    if (m_data) {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_open = false;
+}
+
+#endif
+
+#endif
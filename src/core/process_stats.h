@@ -0,0 +1,43 @@
+#ifndef PROCESS_STATS_H
+#define PROCESS_STATS_H
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Largest resident set size of this process so far, in bytes (0 if the
+// platform cannot tell)
+inline size_t peak_rss_bytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                             sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss); // bytes
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
+
+inline double bytes_to_mb(size_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+#endif
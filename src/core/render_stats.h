@@ -0,0 +1,158 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+// Hot-path counters. Set RT_ENABLE_STATS to 0 (CMake option of the same
+// name) to compile every RT_STAT_ADD away.
+#ifndef RT_ENABLE_STATS
+#define RT_ENABLE_STATS 1
+#endif
+
+enum RenderCounter {
+    kCameraRays,
+    kBounceRays,      // every path segment after the camera ray
+    kShadowRays,      // light sampling visibility tests
+    kBvhNodesVisited, // box tests of BVH nodes (a wide node is one)
+    kPrimitiveTests,  // hit() calls from BVH leaves, at every level
+    kRussianRouletteKills,
+    kRenderCounterCount
+};
+
+// Each thread counts into its own copy; the renderer's workers hand theirs
+// to Renderer::render when they finish
+struct RenderCounters {
+    long long value[kRenderCounterCount] = {};
+
+    void clear() {
+        std::fill(value, value + kRenderCounterCount, 0LL);
+    }
+};
+
+inline RenderCounters &thread_render_counters() {
+    static thread_local RenderCounters counters;
+    return counters;
+}
+
+#if RT_ENABLE_STATS
+#define RT_STAT_ADD(counter, amount)                                           \
+    (thread_render_counters().value[counter] += (amount))
+#else
+#define RT_STAT_ADD(counter, amount) ((void)sizeof(amount))
+#endif
+
+// Totals of one Renderer::render call
+struct RenderStats {
+    long long counters[kRenderCounterCount] = {};
+    double render_seconds = 0.0;
+    int threads = 0;
+    int samples_per_pixel = 0;
+
+    // Wall time per tile, summed over passes, row-major from the tile at
+    // buffer row 0; tile_size x tile_size pixels each
+    int tile_size = 0;
+    int tiles_x = 0;
+    int tiles_y = 0;
+    std::vector<double> tile_seconds;
+    long long tiles_stolen = 0; // taken from another worker's queue
+
+    // Wall time per pixel (row 0 at the bottom, like RenderBuffer), summed
+    // over passes; only filled when Renderer::set_cost_heatmap(true)
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixel_seconds;
+
+    void add(const RenderCounters &thread_counters) {
+        for (int c = 0; c < kRenderCounterCount; c++) {
+            counters[c] += thread_counters.value[c];
+        }
+    }
+
+    long long rays() const {
+        return counters[kCameraRays] + counters[kBounceRays] +
+               counters[kShadowRays];
+    }
+
+    // Segments per camera path, camera ray included
+    double average_path_length() const {
+        return counters[kCameraRays] > 0
+                   ? static_cast<double>(counters[kCameraRays] +
+                                         counters[kBounceRays]) /
+                         counters[kCameraRays]
+                   : 0.0;
+    }
+
+    double per_ray(RenderCounter counter) const {
+        return rays() > 0 ? static_cast<double>(counters[counter]) / rays()
+                          : 0.0;
+    }
+
+    void print(std::ostream &out) const;
+    void write_json(std::ostream &out) const;
+};
+
+inline void RenderStats::print(std::ostream &out) const {
+    const double seconds = std::max(render_seconds, 1e-9);
+    out << std::fixed << std::setprecision(2);
+    out << "Render stats: " << counters[kCameraRays] * 1e-6
+        << " M camera, " << counters[kBounceRays] * 1e-6 << " M bounce, "
+        << counters[kShadowRays] * 1e-6 << " M shadow rays ("
+        << rays() / seconds * 1e-6 << " Mrays/s on " << threads
+        << (threads == 1 ? " thread)\n" : " threads)\n");
+    out << "  path length " << average_path_length() << " on average, "
+        << counters[kRussianRouletteKills]
+        << " Russian roulette terminations\n";
+    out << "  " << per_ray(kBvhNodesVisited) << " BVH nodes and "
+        << per_ray(kPrimitiveTests) << " primitive tests per ray\n";
+    if (!tile_seconds.empty()) {
+        auto fastest =
+            std::min_element(tile_seconds.begin(), tile_seconds.end());
+        auto slowest =
+            std::max_element(tile_seconds.begin(), tile_seconds.end());
+        double total = 0.0;
+        for (double t : tile_seconds) {
+            total += t;
+        }
+        const int index = static_cast<int>(slowest - tile_seconds.begin());
+        out << "  tiles: " << *fastest * 1e3 << " / "
+            << total / tile_seconds.size() * 1e3 << " / " << *slowest * 1e3
+            << " ms (min / mean / max), slowest at pixel ("
+            << index % tiles_x * tile_size << ", "
+            << index / tiles_x * tile_size << "), " << tiles_stolen
+            << " stolen\n";
+    }
+    out << std::defaultfloat << std::setprecision(6) << std::flush;
+}
+
+inline void RenderStats::write_json(std::ostream &out) const {
+    out << std::setprecision(9);
+    out << "{\n"
+        << "  \"render_seconds\": " << render_seconds << ",\n"
+        << "  \"threads\": " << threads << ",\n"
+        << "  \"samples_per_pixel\": " << samples_per_pixel << ",\n"
+        << "  \"camera_rays\": " << counters[kCameraRays] << ",\n"
+        << "  \"bounce_rays\": " << counters[kBounceRays] << ",\n"
+        << "  \"shadow_rays\": " << counters[kShadowRays] << ",\n"
+        << "  \"rays_per_second\": "
+        << (render_seconds > 0 ? rays() / render_seconds : 0.0) << ",\n"
+        << "  \"bvh_nodes_visited\": " << counters[kBvhNodesVisited] << ",\n"
+        << "  \"primitive_tests\": " << counters[kPrimitiveTests] << ",\n"
+        << "  \"average_path_length\": " << average_path_length() << ",\n"
+        << "  \"russian_roulette_terminations\": "
+        << counters[kRussianRouletteKills] << ",\n"
+        << "  \"tile_size\": " << tile_size << ",\n"
+        << "  \"tiles_x\": " << tiles_x << ",\n"
+        << "  \"tiles_y\": " << tiles_y << ",\n"
+        << "  \"tiles_stolen\": " << tiles_stolen << ",\n"
+        << "  \"tile_seconds\": [";
+    for (size_t i = 0; i < tile_seconds.size(); i++) {
+        out << (i == 0 ? "" : ", ") << tile_seconds[i];
+    }
+    out << "]\n}\n";
+    out << std::defaultfloat << std::setprecision(6);
+}
+
+#endif
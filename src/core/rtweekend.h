@@ -2,11 +2,13 @@
 #define RTWEEKEND_H
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <limits>
 #include <memory>
 #include <random>
-#include <thread>
+
+#include "sampler.h"
 
 using std::make_shared;
 using std::make_unique;
@@ -21,16 +23,115 @@ inline constexpr double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
-inline double random_double() {
+// Counter-based random numbers: a draw is a hash of the current key and of
+// how many draws were made under that key (its dimension), so its value
+// never depends on which thread made it or on what that thread did before.
+// The renderer sets one key per (seed, pixel, sample), and with it the
+// sampler that replaces the hash (sampler.h).
+struct random_stream {
+    uint64_t key;
+    uint64_t dimension;
+    SamplerType sampler;
+    uint32_t seed;       // of the render
+    uint32_t pixel_seed; // hash of seed and pixel
+    uint32_t sample;     // index within the pixel
+    int x, y;            // pixel
+    uint32_t pair_index; // Sobol index of the current pair of dimensions
+};
+
+inline random_stream &random_state() {
+    static thread_local random_stream stream{
+        0x853c49e6748fea9bULL, 0, SamplerType::kIndependent, 0, 0, 0, 0, 0, 0};
+    return stream;
+}
 
-    static thread_local uint32_t seed =
-        std::hash<std::thread::id>{}(std::this_thread::get_id());
+// splitmix64 finaliser
+inline uint64_t mix_bits(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
 
-    seed ^= seed << 13;
-    seed ^= seed >> 17;
-    seed ^= seed << 5;
+// Restarts the calling thread's random stream with an arbitrary key, for
+// work outside the per-sample keys (tools, tests)
+inline void seed_random(uint32_t seed) {
+    random_state() = {mix_bits(seed), 0, SamplerType::kIndependent, 0, 0, 0,
+                      0, 0, 0};
+}
+
+// Key of sample `sample` of pixel (x, y) in a render with this seed
+inline void
+seed_random_sample(uint32_t seed, int x, int y, uint32_t sample,
+                   SamplerType sampler = SamplerType::kIndependent) {
+    const uint32_t pixel = (static_cast<uint32_t>(y) << 16) ^
+                           static_cast<uint32_t>(x);
+    uint64_t key = mix_bits((static_cast<uint64_t>(seed) << 32) | pixel);
+    random_state() = {mix_bits(key + sample),
+                      0,
+                      sampler,
+                      seed,
+                      hash_combine(hash_bits(seed), pixel),
+                      sample,
+                      x,
+                      y,
+                      0};
+}
+
+// Uniform in [0, 1): 53 random bits, or the sampler's value for this
+// dimension of the current sample
+inline double random_double() {
+    random_stream &stream = random_state();
+    const uint32_t dimension = static_cast<uint32_t>(stream.dimension++);
+    switch (stream.sampler) {
+    case SamplerType::kHalton:
+        if (dimension < kHaltonDimensions) {
+            return halton(stream.sample, dimension, stream.pixel_seed);
+        }
+        // Sobol beyond the Halton dimensions
+        // fall through
+    case SamplerType::kSobol:
+    case SamplerType::kBlueNoise: {
+        // Blue noise shares one sequence between all pixels
+        const uint32_t seed = stream.sampler == SamplerType::kBlueNoise
+                                  ? stream.seed
+                                  : stream.pixel_seed;
+        // Draws come in order, so an odd dimension finds its pair's index
+        if ((dimension & 1) == 0) {
+            stream.pair_index =
+                sobol_pair_index(stream.sample, dimension >> 1, seed);
+        }
+        uint32_t bits = sobol_pair_bits(stream.pair_index, dimension, seed);
+        if (stream.sampler == SamplerType::kBlueNoise) {
+            bits = blue_noise_rotate(bits, dimension, seed, stream.x, stream.y);
+        }
+        return bits_to_unit(bits);
+    }
+    case SamplerType::kIndependent:
+    default:
+        break;
+    }
+    uint64_t z =
+        mix_bits(stream.key + stream.dimension * 0x9e3779b97f4a7c15ULL);
+    return static_cast<double>(z >> 11) * 1.1102230246251565e-16;
+}
 
-    return seed * 2.3283064365386963e-10;
+// Next two dimensions as one 2D point, for the pixel and lens positions.
+// The independent sampler takes it from a Sobol pair scrambled per pixel,
+// so the samples of a pixel are stratified in 2D (jittered on a 2^k x 2^k
+// grid whenever the spp is 4^k) while every other draw stays white noise.
+inline void random_double_2d(double &u, double &v) {
+    random_stream &stream = random_state();
+    if (stream.sampler != SamplerType::kIndependent) {
+        u = random_double();
+        v = random_double();
+        return;
+    }
+    const uint32_t dimension = static_cast<uint32_t>(stream.dimension);
+    stream.dimension += 2;
+    const uint32_t index =
+        sobol_pair_index(stream.sample, dimension, stream.pixel_seed);
+    u = bits_to_unit(sobol_pair_bits(index, dimension, stream.pixel_seed));
+    v = bits_to_unit(sobol_pair_bits(index, dimension + 1, stream.pixel_seed));
 }
 
 inline double random_double(double min, double max) noexcept {
@@ -0,0 +1,311 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Where random_double() takes its values from while a render sample is
+// active (see seed_random_sample in rtweekend.h). A sample's draws are
+// numbered from 0 (pixel jitter x, y, then lens, time and one group per
+// bounce); the low-discrepancy samplers stratify each dimension over the
+// samples of a pixel.
+enum class SamplerType {
+    kIndependent, // a hash per draw (random_double_2d: stratified)
+    kSobol,       // Owen-scrambled Sobol, padded two dimensions at a time
+    kHalton,      // Halton in the first kHaltonDimensions, digits scrambled
+    kBlueNoise,   // one Sobol sequence for all pixels, rotated per pixel by
+                  // a blue-noise mask so the error is blue noise too
+};
+
+constexpr int kHaltonDimensions = 16;
+
+inline bool parse_sampler(const std::string &name, SamplerType &type) {
+    if (name == "independent") {
+        type = SamplerType::kIndependent;
+    } else if (name == "sobol") {
+        type = SamplerType::kSobol;
+    } else if (name == "halton") {
+        type = SamplerType::kHalton;
+    } else if (name == "bluenoise") {
+        type = SamplerType::kBlueNoise;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline const char *sampler_name(SamplerType type) {
+    switch (type) {
+    case SamplerType::kSobol:
+        return "sobol";
+    case SamplerType::kHalton:
+        return "halton";
+    case SamplerType::kBlueNoise:
+        return "bluenoise";
+    case SamplerType::kIndependent:
+    default:
+        return "independent";
+    }
+}
+
+// lowbias32 by Chris Wellons
+inline uint32_t hash_bits(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+inline uint32_t hash_combine(uint32_t seed, uint32_t value) {
+    return seed ^ (hash_bits(value) + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+inline uint32_t reverse_bits(uint32_t x) {
+#if defined(__GNUC__)
+    x = __builtin_bswap32(x);
+#else
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+#endif
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+// Laine-Karras hash: an Owen scramble of a bit-reversed 32-bit fraction
+// (Burley 2020, "Practical Hash-based Owen Scrambling")
+inline uint32_t laine_karras(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+// Owen scrambling of a 32-bit fraction. Also shuffles sample indices, as
+// scrambling an index keeps every power-of-two prefix stratified.
+inline uint32_t owen_scramble(uint32_t x, uint32_t seed) {
+    return reverse_bits(laine_karras(reverse_bits(x), seed));
+}
+
+// Second Sobol dimension, bit-reversed, one table per index byte: entry b
+// of table k is the xor of the direction numbers of the bits in b << 8k
+struct sobol_tables {
+    uint32_t bytes[4][256];
+
+    sobol_tables() {
+        uint32_t direction[32];
+        uint32_t v = 1u << 31;
+        for (int bit = 0; bit < 32; bit++, v ^= v >> 1) {
+            direction[bit] = reverse_bits(v);
+        }
+        for (int k = 0; k < 4; k++) {
+            for (int b = 0; b < 256; b++) {
+                uint32_t x = 0;
+                for (int bit = 0; bit < 8; bit++) {
+                    if (b & (1 << bit)) {
+                        x ^= direction[8 * k + bit];
+                    }
+                }
+                bytes[k][b] = x;
+            }
+        }
+    }
+};
+
+// Dimension 0 or 1 of the Sobol sequence, a (0, 2)-sequence, as a
+// bit-reversed 32-bit fraction (the form laine_karras takes)
+inline uint32_t sobol_bits_reversed(uint32_t index, int dimension) {
+    if (dimension == 0) {
+        return index;
+    }
+    static const sobol_tables tables;
+    return tables.bytes[0][index & 0xff] ^
+           tables.bytes[1][(index >> 8) & 0xff] ^
+           tables.bytes[2][(index >> 16) & 0xff] ^ tables.bytes[3][index >> 24];
+}
+
+inline double bits_to_unit(uint32_t bits) {
+    return bits * 2.3283064365386963e-10;
+}
+
+// Dimensions 2k and 2k+1 of a sample are one 2D Sobol point; its index is
+// the sample index shuffled by seed and k
+inline uint32_t sobol_pair_index(uint32_t sample, uint32_t pair,
+                                 uint32_t seed) {
+    return owen_scramble(sample, hash_combine(seed, pair));
+}
+
+inline uint32_t sobol_pair_bits(uint32_t index, uint32_t dimension,
+                                uint32_t seed) {
+    return reverse_bits(
+        laine_karras(sobol_bits_reversed(index, dimension & 1),
+                     hash_combine(seed, 0x80000000u | dimension)));
+}
+
+// Dimension `dimension` of sample `sample`, padded Owen-scrambled Sobol
+inline double owen_sobol(uint32_t sample, uint32_t dimension, uint32_t seed) {
+    return bits_to_unit(sobol_pair_bits(
+        sobol_pair_index(sample, dimension >> 1, seed), dimension, seed));
+}
+
+// Radical inverse of index in base, a prime, with every digit mapped
+// through d -> a d + b (mod base), a and b hashed from the digits before it
+// (Matousek's random linear scrambling, nested). A plain shift would leave
+// the first few samples of two large bases on a line. Past the last
+// digit of index the scrambled digits are uniform, so one random fraction
+// stands in for all of them.
+inline double scrambled_radical_inverse(uint32_t base, uint32_t index,
+                                        uint32_t seed) {
+    const double inv_base = 1.0 / base;
+    double inv = 1.0;
+    double result = 0.0;
+    uint32_t prefix = seed;
+    while (index > 0) {
+        const uint32_t next = index / base;
+        const uint32_t h = hash_bits(prefix);
+        const uint32_t digit =
+            ((1 + (h >> 16) % (base - 1)) * (index - next * base) +
+             (h & 0xffff)) %
+            base;
+        inv *= inv_base;
+        result += digit * inv;
+        prefix = hash_combine(prefix, digit);
+        index = next;
+    }
+    result += inv * bits_to_unit(hash_bits(prefix ^ 0x68bc21ebu));
+    return std::min(result, 0.99999999999999989);
+}
+
+inline double halton(uint32_t sample, uint32_t dimension, uint32_t seed) {
+    static const uint32_t kPrimes[kHaltonDimensions] = {
+        2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53};
+    return scrambled_radical_inverse(kPrimes[dimension], sample,
+                                     hash_combine(seed, dimension));
+}
+
+// 64x64 tileable blue-noise ranks as 32-bit fractions, made once by void
+// and cluster (Ulichney 1993) with a Gaussian energy of sigma 1.5 on the
+// torus
+constexpr int kBlueNoiseSize = 64;
+
+inline std::vector<uint32_t> make_blue_noise_mask() {
+    const int n = kBlueNoiseSize;
+    const int count = n * n;
+    std::vector<float> kernel(count);
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            int dx = x < n / 2 ? x : n - x;
+            int dy = y < n / 2 ? y : n - y;
+            kernel[y * n + x] =
+                static_cast<float>(std::exp(-(dx * dx + dy * dy) / 4.5));
+        }
+    }
+    std::vector<char> on(count, 0);
+    std::vector<float> energy(count, 0.0f);
+    auto splat = [&](int p, float sign) {
+        const int px = p % n;
+        const int py = p / n;
+        for (int y = 0; y < n; y++) {
+            const float *k = &kernel[((y - py + n) % n) * n];
+            float *e = &energy[y * n];
+            for (int x = 0; x < n; x++) {
+                e[x] += sign * k[(x - px + n) % n];
+            }
+        }
+    };
+    // Tightest cluster among the set cells, or largest void among the
+    // empty ones
+    auto extreme = [&](char state) {
+        int best = -1;
+        for (int p = 0; p < count; p++) {
+            if (on[p] != state) {
+                continue;
+            }
+            if (best < 0 || (state ? energy[p] > energy[best]
+                                   : energy[p] < energy[best])) {
+                best = p;
+            }
+        }
+        return best;
+    };
+
+    // Initial pattern: 10% random points, then relaxed until moving the
+    // tightest cluster into the largest void no longer changes anything
+    const int initial = count / 10;
+    for (uint32_t i = 0, placed = 0; placed < static_cast<uint32_t>(initial);
+         i++) {
+        int p = static_cast<int>(hash_bits(i + 0x5bd1e995u) % count);
+        if (!on[p]) {
+            on[p] = 1;
+            splat(p, 1.0f);
+            placed++;
+        }
+    }
+    for (int step = 0; step < count; step++) {
+        int cluster = extreme(1);
+        on[cluster] = 0;
+        splat(cluster, -1.0f);
+        int void_cell = extreme(0);
+        on[void_cell] = 1;
+        splat(void_cell, 1.0f);
+        if (void_cell == cluster) {
+            break;
+        }
+    }
+
+    std::vector<int> rank(count, 0);
+    std::vector<char> prototype = on;
+    std::vector<float> prototype_energy = energy;
+    // Ranks below the initial points: remove the tightest cluster first
+    for (int r = initial - 1; r >= 0; r--) {
+        int cluster = extreme(1);
+        on[cluster] = 0;
+        splat(cluster, -1.0f);
+        rank[cluster] = r;
+    }
+    // Ranks above: fill the largest void first
+    on = prototype;
+    energy = prototype_energy;
+    for (int r = initial; r < count; r++) {
+        int void_cell = extreme(0);
+        on[void_cell] = 1;
+        splat(void_cell, 1.0f);
+        rank[void_cell] = r;
+    }
+
+    // Middle of each rank's interval
+    std::vector<uint32_t> mask(count);
+    for (int p = 0; p < count; p++) {
+        mask[p] = static_cast<uint32_t>(
+            (2 * static_cast<uint64_t>(rank[p]) + 1) * (1ull << 31) / count);
+    }
+    return mask;
+}
+
+inline const std::vector<uint32_t> &blue_noise_mask() {
+    static const std::vector<uint32_t> mask = make_blue_noise_mask();
+    return mask;
+}
+
+// Shifts bits, a dimension of the Sobol point shared by every pixel, by the
+// mask at pixel (px, py), modulo 1. Each dimension reads the mask at its own
+// offset, so the shifts of two dimensions are not the same pattern.
+inline uint32_t blue_noise_rotate(uint32_t bits, uint32_t dimension,
+                                  uint32_t render_seed, int px, int py) {
+    static const std::vector<uint32_t> &mask = blue_noise_mask();
+    // Golden-ratio steps keep the offsets of nearby dimensions apart
+    const uint32_t offset = (render_seed + dimension) * 0x9e3779b9u;
+    const int mx = (px + static_cast<int>(offset >> 26)) & 63;
+    const int my = (py + static_cast<int>((offset >> 20) & 63)) & 63;
+    return bits + mask[my * kBlueNoiseSize + mx];
+}
+
+#endif
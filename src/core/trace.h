@@ -0,0 +1,178 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Timeline of scoped events in the Chrome trace JSON format, for
+// chrome://tracing or ui.perfetto.dev. Off until start_trace(); while off a
+// trace_scope costs one atomic load.
+struct trace_event {
+    const char *name;
+    const char *category;
+    long long start_ns; // since start_trace()
+    long long duration_ns;
+    int tid;
+    std::string args; // JSON members without braces, may be empty
+};
+
+struct trace_log {
+    std::atomic<bool> enabled{false};
+    std::chrono::steady_clock::time_point epoch;
+    std::mutex mutex;
+    std::vector<trace_event> events;
+    std::map<int, std::string> thread_names;
+    std::atomic<int> next_tid{100}; // threads that never bound an id
+};
+
+inline trace_log &global_trace() {
+    static trace_log log;
+    return log;
+}
+
+inline bool trace_enabled() {
+    return global_trace().enabled.load(std::memory_order_relaxed);
+}
+
+inline void start_trace() {
+    trace_log &log = global_trace();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    log.events.clear();
+    log.epoch = std::chrono::steady_clock::now();
+    log.enabled = true;
+}
+
+inline int &trace_thread_id() {
+    static thread_local int tid = -1;
+    if (tid < 0) {
+        tid = global_trace().next_tid++;
+    }
+    return tid;
+}
+
+// Puts this thread's events on row tid of the timeline. Workers bind their
+// index, so every pass of the renderer reuses the same rows.
+inline void trace_bind_thread(int tid, const std::string &name) {
+    trace_thread_id() = tid;
+    if (!trace_enabled()) {
+        return;
+    }
+    trace_log &log = global_trace();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    log.thread_names[tid] = name;
+}
+
+inline void record_trace_event(const char *name, const char *category,
+                               std::chrono::steady_clock::time_point start,
+                               std::chrono::steady_clock::time_point end,
+                               std::string args = std::string()) {
+    if (!trace_enabled()) {
+        return;
+    }
+    trace_log &log = global_trace();
+    trace_event event;
+    event.name = name;
+    event.category = category;
+    event.duration_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count();
+    event.tid = trace_thread_id();
+    event.args = std::move(args);
+    std::lock_guard<std::mutex> lock(log.mutex);
+    event.start_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(start - log.epoch)
+            .count();
+    log.events.push_back(std::move(event));
+}
+
+// "key": value members for the args of an event
+inline std::string trace_arg(const char *key, long long value) {
+    return std::string("\"") + key + "\": " + std::to_string(value);
+}
+
+inline std::string trace_arg(const char *key, const std::string &value) {
+    std::string out = std::string("\"") + key + "\": \"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+    }
+    return out + "\"";
+}
+
+// Records its own lifetime as one complete ("X") event
+class trace_scope {
+  public:
+    trace_scope(const char *name, const char *category,
+                std::string args = std::string())
+        : m_name(name), m_category(category), m_active(trace_enabled()) {
+        if (m_active) {
+            m_args = std::move(args);
+            m_start = std::chrono::steady_clock::now();
+        }
+    }
+    ~trace_scope() {
+        if (m_active) {
+            record_trace_event(m_name, m_category, m_start,
+                               std::chrono::steady_clock::now(),
+                               std::move(m_args));
+        }
+    }
+
+    trace_scope(const trace_scope &) = delete;
+    trace_scope &operator=(const trace_scope &) = delete;
+
+  private:
+    const char *m_name;
+    const char *m_category;
+    bool m_active;
+    std::string m_args;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Writes everything recorded since start_trace(); false if the file could
+// not be written
+inline bool write_trace(const std::string &filename) {
+    trace_log &log = global_trace();
+    std::lock_guard<std::mutex> lock(log.mutex);
+    FILE *file = std::fopen(filename.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    const char *separator = "";
+    for (const auto &thread : log.thread_names) {
+        std::string name = trace_arg("name", thread.second);
+        std::fprintf(file,
+                     "%s{\"name\": \"thread_name\", \"ph\": \"M\", "
+                     "\"pid\": 1, \"tid\": %d, \"args\": {%s}},\n"
+                     "{\"name\": \"thread_sort_index\", \"ph\": \"M\", "
+                     "\"pid\": 1, \"tid\": %d, \"args\": {\"sort_index\": "
+                     "%d}}",
+                     separator, thread.first, name.c_str(), thread.first,
+                     thread.first);
+        separator = ",\n";
+    }
+    for (const auto &event : log.events) {
+        // Timestamps are in microseconds
+        std::fprintf(file,
+                     "%s{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+                     "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d, "
+                     "\"args\": {%s}}",
+                     separator, event.name, event.category,
+                     event.start_ns * 1e-3, event.duration_ns * 1e-3,
+                     event.tid, event.args.c_str());
+        separator = ",\n";
+    }
+    std::fprintf(file, "\n]}\n");
+    return std::fclose(file) == 0;
+}
+
+#endif
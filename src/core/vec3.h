@@ -256,6 +256,25 @@ inline vec3 random_in_unit_disk() {
     }
 }
 
+// Shirley-Chiu concentric mapping of [0, 1)^2 onto the unit disk: keeps the
+// strata of (u1, u2) compact and needs no rejection
+inline vec3 concentric_disk(double u1, double u2) {
+    double a = 2 * u1 - 1;
+    double b = 2 * u2 - 1;
+    if (a == 0 && b == 0) {
+        return vec3(0, 0, 0);
+    }
+    double r, theta;
+    if (fabs(a) > fabs(b)) {
+        r = a;
+        theta = (pi / 4) * (b / a);
+    } else {
+        r = b;
+        theta = (pi / 2) - (pi / 4) * (a / b);
+    }
+    return vec3(r * cos(theta), r * sin(theta), 0);
+}
+
 // 余弦加权半球采样
 
 inline vec3 random_cosine_direction() {
@@ -8,6 +8,22 @@ namespace {
 constexpr double kAABBPadding = 0.0001;
 }
 
+// Hit of r with the rectangle [a0, a1] x [b0, b1] in the plane where axis K
+// equals k: distance t and the hit point's coordinates a, b along axes A
+// and B. Shared by the rect classes and primitive_store.
+template <int K, int A, int B>
+inline bool axis_rect_hit(const ray &r, double a0, double a1, double b0,
+                          double b1, double k, double t_min, double t_max,
+                          double &t, double &a, double &b) {
+    t = (k - r.origin()[K]) / r.direction()[K];
+    if (t < t_min || t > t_max) {
+        return false;
+    }
+    a = r.origin()[A] + t * r.direction()[A];
+    b = r.origin()[B] + t * r.direction()[B];
+    return !(a < a0 || a > a1 || b < b0 || b > b1);
+}
+
 class xy_rect : public hittable {
   public:
     xy_rect() {
@@ -27,6 +43,18 @@ class xy_rect : public hittable {
         return true;
     }
 
+    virtual bool occluded(const ray &r, double t_min,
+                          double t_max) const override {
+        double t, x, y;
+        return axis_rect_hit<2, 0, 1>(r, x0, x1, y0, y1, k, t_min, t_max,
+                                      t, x, y);
+    }
+
+    virtual bool intersect(const ray &r, double t_min, double t_max,
+                           hit_record &rec) const override;
+
+    virtual void surface(const ray &r, hit_record &rec) const override;
+
   public:
     shared_ptr<material> mp;
     double x0, x1, y0, y1, k;
@@ -49,6 +77,17 @@ class xz_rect : public hittable {
         return true;
     }
 
+    virtual bool occluded(const ray &r, double t_min, double t_max) const {
+        double t, x, z;
+        return axis_rect_hit<1, 0, 2>(r, x0, x1, z0, z1, k, t_min, t_max,
+                                      t, x, z);
+    }
+
+    virtual bool intersect(const ray &r, double t_min, double t_max,
+                           hit_record &rec) const;
+
+    virtual void surface(const ray &r, hit_record &rec) const;
+
   public:
     shared_ptr<material> mp;
     double x0, x1, z0, z1, k;
@@ -71,66 +110,119 @@ class yz_rect : public hittable {
         return true;
     }
 
+    virtual bool occluded(const ray &r, double t_min, double t_max) const {
+        double t, y, z;
+        return axis_rect_hit<0, 1, 2>(r, y0, y1, z0, z1, k, t_min, t_max,
+                                      t, y, z);
+    }
+
+    virtual bool intersect(const ray &r, double t_min, double t_max,
+                           hit_record &rec) const;
+
+    virtual void surface(const ray &r, hit_record &rec) const;
+
   public:
     shared_ptr<material> mp;
     double y0, y1, z0, z1, k;
 };
 
-bool xy_rect::hit(const ray &r, double t_min, double t_max,
-                  hit_record &rec) const {
-    auto t = (k - r.origin().z()) / r.direction().z();
-    if (t < t_min || t > t_max) {
-        return false;
-    }
-    auto x = r.origin().x() + t * r.direction().x();
-    auto y = r.origin().y() + t * r.direction().y();
-    if (x < x0 || x > x1 || y < y0 || y > y1) {
+// The hit point's in-plane coordinates wait in u and v until surface()
+inline bool xy_rect::intersect(const ray &r, double t_min, double t_max,
+                               hit_record &rec) const {
+    double t, x, y;
+    if (!axis_rect_hit<2, 0, 1>(r, x0, x1, y0, y1, k, t_min, t_max, t,
+                                x, y)) {
         return false;
     }
-    rec.u = (x - x0) / (x1 - x0);
-    rec.v = (y - y0) / (y1 - y0);
     rec.t = t;
+    rec.u = x;
+    rec.v = y;
+    rec.object = this;
+    rec.transform_count = 0;
+    return true;
+}
 
+inline void xy_rect::surface(const ray &r, hit_record &rec) const {
+    rec.u = (rec.u - x0) / (x1 - x0);
+    rec.v = (rec.v - y0) / (y1 - y0);
     auto outward_normal = vec3(0, 0, 1);
     rec.set_face_normal(r, outward_normal);
     rec.mat_ptr = mp.get();
-    rec.p = r.at(t);
-    return true;
+    rec.p = r.at(rec.t);
 }
 
-bool xz_rect::hit(const ray &r, double t_min, double t_max, hit_record &rec) const {
-    auto t = (k - r.origin().y()) / r.direction().y();
-    if (t < t_min || t > t_max)
+inline bool xy_rect::hit(const ray &r, double t_min, double t_max,
+                         hit_record &rec) const {
+    if (!intersect(r, t_min, t_max, rec)) {
         return false;
-    auto x = r.origin().x() + t * r.direction().x();
-    auto z = r.origin().z() + t * r.direction().z();
-    if (x < x0 || x > x1 || z < z0 || z > z1)
+    }
+    surface(r, rec);
+    return true;
+}
+
+inline bool xz_rect::intersect(const ray &r, double t_min, double t_max,
+                               hit_record &rec) const {
+    double t, x, z;
+    if (!axis_rect_hit<1, 0, 2>(r, x0, x1, z0, z1, k, t_min, t_max, t,
+                                x, z)) {
         return false;
-    rec.u = (x - x0) / (x1 - x0);
-    rec.v = (z - z0) / (z1 - z0);
+    }
     rec.t = t;
+    rec.u = x;
+    rec.v = z;
+    rec.object = this;
+    rec.transform_count = 0;
+    return true;
+}
+
+inline void xz_rect::surface(const ray &r, hit_record &rec) const {
+    rec.u = (rec.u - x0) / (x1 - x0);
+    rec.v = (rec.v - z0) / (z1 - z0);
     vec3 outward_normal = vec3(0, 1, 0);
     rec.set_face_normal(r, outward_normal);
     rec.mat_ptr = mp.get();
-    rec.p = r.at(t);
-    return true;
+    rec.p = r.at(rec.t);
 }
 
-bool yz_rect::hit(const ray &r, double t_min, double t_max, hit_record &rec) const {
-    auto t = (k - r.origin().x()) / r.direction().x();
-    if (t < t_min || t > t_max)
+inline bool xz_rect::hit(const ray &r, double t_min, double t_max,
+                         hit_record &rec) const {
+    if (!intersect(r, t_min, t_max, rec)) {
         return false;
-    auto y = r.origin().y() + t * r.direction().y();
-    auto z = r.origin().z() + t * r.direction().z();
-    if (y < y0 || y > y1 || z < z0 || z > z1)
+    }
+    surface(r, rec);
+    return true;
+}
+
+inline bool yz_rect::intersect(const ray &r, double t_min, double t_max,
+                               hit_record &rec) const {
+    double t, y, z;
+    if (!axis_rect_hit<0, 1, 2>(r, y0, y1, z0, z1, k, t_min, t_max, t,
+                                y, z)) {
         return false;
-    rec.u = (y - y0) / (y1 - y0);
-    rec.v = (z - z0) / (z1 - z0);
+    }
     rec.t = t;
+    rec.u = y;
+    rec.v = z;
+    rec.object = this;
+    rec.transform_count = 0;
+    return true;
+}
+
+inline void yz_rect::surface(const ray &r, hit_record &rec) const {
+    rec.u = (rec.u - y0) / (y1 - y0);
+    rec.v = (rec.v - z0) / (z1 - z0);
     vec3 outward_normal = vec3(1, 0, 0);
     rec.set_face_normal(r, outward_normal);
     rec.mat_ptr = mp.get();
-    rec.p = r.at(t);
+    rec.p = r.at(rec.t);
+}
+
+inline bool yz_rect::hit(const ray &r, double t_min, double t_max,
+                         hit_record &rec) const {
+    if (!intersect(r, t_min, t_max, rec)) {
+        return false;
+    }
+    surface(r, rec);
     return true;
 }
 
@@ -0,0 +1,91 @@
+#ifndef ACCELERATOR_H
+#define ACCELERATOR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "linear_bvh.h"
+#include "wide_bvh.h"
+
+// Acceleration structures that can stand in for a hittable_list
+enum class accelerator_type {
+    bvh,        // bvh_node: tree of shared_ptr nodes, recursive traversal
+    linear_bvh, // linear_bvh: flat node array, iterative traversal
+    bvh4,       // wide_bvh<4>: 4 children per node, SSE box tests
+    bvh8,       // wide_bvh<8>: 8 children per node, AVX box tests
+};
+
+// Used by make_accelerator() when no type is given. Set it before building
+// a scene (select_scene, mesh::load_from_obj) to switch every BVH at once.
+inline accelerator_type &default_accelerator() {
+    static accelerator_type type = accelerator_type::linear_bvh;
+    return type;
+}
+
+inline void set_default_accelerator(accelerator_type type) {
+    default_accelerator() = type;
+}
+
+// "bvh", "linear", "bvh4" or "bvh8"; returns false for anything else
+inline bool parse_accelerator(const std::string &name,
+                              accelerator_type &type) {
+    if (name == "bvh") {
+        type = accelerator_type::bvh;
+    } else if (name == "linear") {
+        type = accelerator_type::linear_bvh;
+    } else if (name == "bvh4") {
+        type = accelerator_type::bvh4;
+    } else if (name == "bvh8") {
+        type = accelerator_type::bvh8;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline shared_ptr<hittable>
+make_accelerator(const std::vector<shared_ptr<hittable>> &objects,
+                 double time0, double time1,
+                 accelerator_type type = default_accelerator()) {
+    switch (type) {
+    case accelerator_type::bvh:
+        return make_shared<bvh_node>(objects, 0, objects.size(), time0,
+                                     time1);
+    case accelerator_type::bvh4:
+        return make_shared<wide_bvh<4>>(objects, time0, time1);
+    case accelerator_type::bvh8:
+        return make_shared<wide_bvh<8>>(objects, time0, time1);
+    case accelerator_type::linear_bvh:
+    default:
+        return make_shared<linear_bvh>(objects, time0, time1);
+    }
+}
+
+// SAH cost of a tree built by make_accelerator(), 0 for other hittables
+inline double accelerator_sah_cost(const hittable &object) {
+    if (auto tree = dynamic_cast<const linear_bvh *>(&object)) {
+        return tree->sah_cost();
+    }
+    if (auto tree = dynamic_cast<const bvh_node *>(&object)) {
+        return tree->sah_cost();
+    }
+    if (auto tree = dynamic_cast<const wide_bvh<4> *>(&object)) {
+        return tree->sah_cost();
+    }
+    if (auto tree = dynamic_cast<const wide_bvh<8> *>(&object)) {
+        return tree->sah_cost();
+    }
+    return 0.0;
+}
+
+inline shared_ptr<hittable>
+make_accelerator(const hittable_list &list, double time0, double time1,
+                 accelerator_type type = default_accelerator()) {
+    return make_accelerator(list.objects, time0, time1, type);
+}
+
+#endif
@@ -22,13 +22,24 @@ class box : public hittable {
         return true;
     }
 
+    virtual bool occluded(const ray &r, double t_min,
+                          double t_max) const override {
+        return sides.occluded(r, t_min, t_max);
+    }
+
+    virtual bool intersect(const ray &r, double t_min, double t_max,
+                           hit_record &rec) const override {
+        return sides.intersect(r, t_min, t_max, rec);
+    }
+
   public:
     point3 box_min;
     point3 box_max;
     hittable_list sides;
 };
 
-box::box(const point3 &p0, const point3 &p1, shared_ptr<material> ptr) {
+inline box::box(const point3 &p0, const point3 &p1,
+                shared_ptr<material> ptr) {
     box_min = p0;
     box_max = p1;
 
@@ -46,7 +57,8 @@ box::box(const point3 &p0, const point3 &p1, shared_ptr<material> ptr) {
         make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), ptr));
 }
 
-bool box::hit(const ray &r, double t_min, double t_max, hit_record &rec) const {
+inline bool box::hit(const ray &r, double t_min, double t_max,
+                     hit_record &rec) const {
     return sides.hit(r, t_min, t_max, rec);
 }
 
@@ -2,35 +2,68 @@
 #define BVH_H
 
 #include <algorithm>
+#include <future>
 #include <iostream>
 #include <stdexcept>
 #include <vector>
 
+#include "bvh_build.h"
 #include "hittable.h"
 #include "hittable_list.h"
 #include "ray.h"
+#include "render_stats.h"
 #include "rtweekend.h"
 #include "vec3.h"
 
 // BVH node
 class bvh_node : public hittable {
   public:
-    bvh_node(const hittable_list& list, double time0, double time1)
-        : bvh_node(list.objects, 0, list.objects.size(), time0, time1) {}
+    bvh_node(const hittable_list& list, double time0, double time1,
+             const bvh_build_options& options = default_bvh_build_options())
+        : bvh_node(list.objects, 0, list.objects.size(), time0, time1,
+                   options) {}
 
     bvh_node(const std::vector<shared_ptr<hittable>>& src_objects,
-             size_t start, size_t end, double time0, double time1);
+             size_t start, size_t end, double time0, double time1,
+             const bvh_build_options& options = default_bvh_build_options());
 
     bool hit(const ray& r, double t_min, double t_max,
              hit_record& rec) const override;
 
+    bool occluded(const ray& r, double t_min, double t_max) const override;
+
+    bool intersect(const ray& r, double t_min, double t_max,
+                   hit_record& rec) const override;
+
     bool bounding_box(double time0, double time1,
                       aabb& output_box) const override;
 
+    // Expected cost of a ray that hits this node's box, in the units of
+    // the build options (see linear_bvh::sah_cost)
+    double sah_cost(const bvh_build_options& options =
+                        default_bvh_build_options()) const;
+
   public:
     shared_ptr<hittable> left;
     shared_ptr<hittable> right;
     aabb box;
+
+  private:
+    // Children that are primitives rather than bvh_nodes (a single
+    // primitive sits in both slots and is tested twice)
+    int leaf_children = 0;
+
+    // State shared by every node of one build: the caller's objects and a
+    // single reference array that the recursion partitions in place.
+    struct build_context {
+        const std::vector<shared_ptr<hittable>>& objects;
+        std::vector<bvh_build_ref>& refs;
+        const bvh_build_options& options;
+        int threads;
+    };
+
+    bvh_node(const build_context& context, size_t start, size_t end,
+             int depth);
 };
 
 inline bool bvh_node::bounding_box(double /*time0*/, double /*time1*/,
@@ -41,105 +74,119 @@ inline bool bvh_node::bounding_box(double /*time0*/, double /*time1*/,
 
 inline bool bvh_node::hit(const ray& r, double t_min, double t_max,
                           hit_record& rec) const {
+    if (!intersect(r, t_min, t_max, rec)) {
+        return false;
+    }
+    finish_hit(r, rec);
+    return true;
+}
+
+inline bool bvh_node::intersect(const ray& r, double t_min, double t_max,
+                                hit_record& rec) const {
+    RT_STAT_ADD(kBvhNodesVisited, 1);
     if (!box.hit(r, t_min, t_max)) {
         return false;
     }
+    RT_STAT_ADD(kPrimitiveTests, leaf_children);
 
-    bool hit_left = left->hit(r, t_min, t_max, rec);
-    bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
+    bool hit_left = left->intersect(r, t_min, t_max, rec);
+    bool hit_right =
+        right->intersect(r, t_min, hit_left ? rec.t : t_max, rec);
     return hit_left || hit_right;
 }
 
-inline bvh_node::bvh_node(const std::vector<shared_ptr<hittable>>& src_objects,
-                          size_t start, size_t end, double time0, double time1) {
-    if (end <= start) {
-        throw std::runtime_error("BVH build error: empty range [start, end).");
+inline bool bvh_node::occluded(const ray& r, double t_min,
+                               double t_max) const {
+    RT_STAT_ADD(kBvhNodesVisited, 1);
+    if (!box.hit(r, t_min, t_max)) {
+        return false;
     }
+    RT_STAT_ADD(kPrimitiveTests, leaf_children);
 
-    // NOTE: Copy because we sort locally
-    auto objects = src_objects;
-
-    // Compute centroid bounds to choose split axis (SAH-lite)
-    bool have_any_centroid = false;
-    aabb centroid_bounds;
-
-    for (size_t i = start; i < end; ++i) {
-        aabb obj_box;
-        if (!objects[i]->bounding_box(time0, time1, obj_box)) {
-            // HARD-FAIL: BVH requires valid AABB for every primitive.
-            // This will tell you exactly which path is missing bounding_box().
-            throw std::runtime_error(
-                "BVH build error: object has no bounding box. "
-                "Implement bounding_box() for all hittables used in BVH.");
-        }
-
-        point3 c = 0.5 * (obj_box.min() + obj_box.max());
-        aabb c_box(c, c);
+    return left->occluded(r, t_min, t_max) ||
+           (right != left && right->occluded(r, t_min, t_max));
+}
 
-        if (!have_any_centroid) {
-            centroid_bounds = c_box;
-            have_any_centroid = true;
+inline double bvh_node::sah_cost(const bvh_build_options& options) const {
+    // Surface-area-weighted cost of this subtree, relative to box
+    double area = surface_area(box);
+    double cost = options.traversal_cost;
+    const hittable* children[2] = {left.get(), right.get()};
+    for (int i = 0; i < (left == right ? 1 : 2); ++i) {
+        auto child = dynamic_cast<const bvh_node*>(children[i]);
+        if (child && area > 0) {
+            cost += child->sah_cost(options) * surface_area(child->box) / area;
+        } else if (child) {
+            cost += child->sah_cost(options);
         } else {
-            centroid_bounds = surrounding_box(centroid_bounds, c_box);
+            cost += options.intersection_cost;
         }
     }
+    return cost;
+}
 
-    // Choose axis with largest extent
-    vec3 extent = centroid_bounds.max() - centroid_bounds.min();
-    int axis = 0;
-    if (extent.y() > extent.x() && extent.y() > extent.z()) {
-        axis = 1;
-    } else if (extent.z() > extent.x()) {
-        axis = 2;
+inline bvh_node::bvh_node(const std::vector<shared_ptr<hittable>>& src_objects,
+                          size_t start, size_t end, double time0, double time1,
+                          const bvh_build_options& options) {
+    bvh_build_timer timer;
+    if (end <= start) {
+        throw std::runtime_error("BVH build error: empty range [start, end).");
     }
 
-    // Comparator: safe + deterministic + uses time0/time1
-    auto comparator = [axis, time0, time1](const shared_ptr<hittable>& a,
-                                          const shared_ptr<hittable>& b) {
-        aabb box_a, box_b;
-        bool ok_a = a->bounding_box(time0, time1, box_a);
-        bool ok_b = b->bounding_box(time0, time1, box_b);
-
-        // If either fails (shouldn't due to hard-fail earlier), provide stable order
-        if (!ok_a || !ok_b) {
-            return a.get() < b.get();
-        }
+    const int threads = bvh_build_threads(options);
+    std::vector<bvh_build_ref> refs =
+        make_bvh_refs(src_objects, start, end, time0, time1, threads);
 
-        point3 ca = 0.5 * (box_a.min() + box_a.max());
-        point3 cb = 0.5 * (box_b.min() + box_b.max());
-        return ca[axis] < cb[axis];
-    };
+    build_context context{src_objects, refs, options, threads};
+    *this = bvh_node(context, 0, refs.size(), 0);
+}
 
+inline bvh_node::bvh_node(const build_context& context, size_t start,
+                          size_t end, int depth) {
+    const auto& refs = context.refs;
     const size_t object_span = end - start;
 
     if (object_span == 1) {
-        left = right = objects[start];
-    } else if (object_span == 2) {
-        if (comparator(objects[start], objects[start + 1])) {
-            left = objects[start];
-            right = objects[start + 1];
-        } else {
-            left = objects[start + 1];
-            right = objects[start];
-        }
-    } else {
-        std::sort(objects.begin() + start, objects.begin() + end, comparator);
-
-        const size_t mid = start + object_span / 2;
-        left = make_shared<bvh_node>(objects, start, mid, time0, time1);
-        right = make_shared<bvh_node>(objects, mid, end, time0, time1);
-    }
-
-    // Build node bbox from children; MUST be valid
-    aabb box_left, box_right;
-    if (!left->bounding_box(time0, time1, box_left)) {
-        throw std::runtime_error("BVH build error: left child has no bounding box.");
+        left = right = context.objects[refs[start].index];
+        box = refs[start].box;
+        leaf_children = 2;
+        return;
     }
-    if (!right->bounding_box(time0, time1, box_right)) {
-        throw std::runtime_error("BVH build error: right child has no bounding box.");
+    if (object_span == 2) {
+        left = context.objects[refs[start].index];
+        right = context.objects[refs[start + 1].index];
+        box = surrounding_box(refs[start].box, refs[start + 1].box);
+        leaf_children = 2;
+        return;
     }
 
-    box = surrounding_box(box_left, box_right);
+    // Binned SAH split; bvh_node has no multi-primitive leaves, so it
+    // always splits
+    const int node_threads = bvh_threads_at_depth(context.threads, depth);
+    aabb centroid_bounds;
+    bvh_range_bounds(refs, start, end, box, centroid_bounds, node_threads);
+    int axis = 0;
+    const size_t mid = bvh_split(context.refs, start, end, box,
+                                 centroid_bounds, context.options, false,
+                                 depth, axis, node_threads);
+
+    // The two halves own disjoint ranges of refs, so the right one can be
+    // built on another thread. The future waits for it even if the left
+    // build throws, and get() passes on what the right one threw.
+    if (node_threads > 1 && end - mid >= kBvhParallelMinPrimitives) {
+        std::future<void> worker = std::async(std::launch::async, [&] {
+            right = shared_ptr<bvh_node>(
+                new bvh_node(context, mid, end, depth + 1));
+        });
+        left =
+            shared_ptr<bvh_node>(new bvh_node(context, start, mid, depth + 1));
+        worker.get();
+    } else {
+        left = shared_ptr<bvh_node>(
+            new bvh_node(context, start, mid, depth + 1));
+        right = shared_ptr<bvh_node>(
+            new bvh_node(context, mid, end, depth + 1));
+    }
 }
 
 #endif // BVH_H
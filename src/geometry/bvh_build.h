@@ -0,0 +1,365 @@
+#ifndef BVH_BUILD_H
+#define BVH_BUILD_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "aabb.h"
+#include "hittable.h"
+#include "trace.h"
+#include "vec3.h"
+
+// Parameters of the binned surface area heuristic shared by the BVH
+// builders. Costs are relative: only their ratio changes the tree.
+struct bvh_build_options {
+    int bins = 16;                  // candidate split planes per axis = bins-1
+    int max_leaf_size = 4;          // linear_bvh only; bvh_node stops at 2
+    double traversal_cost = 1.0;    // one node box test
+    double intersection_cost = 1.0; // one primitive test
+    int num_threads = 0; // 0: one per hardware thread, 1: serial build
+};
+
+// Used by the BVH constructors when no options are given
+inline bvh_build_options &default_bvh_build_options() {
+    static bvh_build_options options;
+    return options;
+}
+
+// Wall-clock seconds spent building BVHs in this process, summed over
+// every top-level build. Benchmarks reset it before building a scene.
+inline std::atomic<long long> &bvh_build_nanoseconds() {
+    static std::atomic<long long> total(0);
+    return total;
+}
+
+inline double bvh_build_seconds() {
+    return bvh_build_nanoseconds().load() * 1e-9;
+}
+
+// Adds its lifetime to bvh_build_nanoseconds() and the trace. Declared at
+// the top of each BVH constructor; a build started inside another one is
+// not counted twice.
+class bvh_build_timer {
+  public:
+    bvh_build_timer() : start(std::chrono::steady_clock::now()) {
+        depth()++;
+    }
+    ~bvh_build_timer() {
+        if (--depth() == 0) {
+            auto end = std::chrono::steady_clock::now();
+            auto elapsed = end - start;
+            bvh_build_nanoseconds() +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                    .count();
+            record_trace_event("bvh_build", "bvh", start, end);
+        }
+    }
+
+    bvh_build_timer(const bvh_build_timer &) = delete;
+    bvh_build_timer &operator=(const bvh_build_timer &) = delete;
+
+  private:
+    static int &depth() {
+        static thread_local int level = 0;
+        return level;
+    }
+
+    std::chrono::steady_clock::time_point start;
+};
+
+// One primitive as seen by the builder
+struct bvh_build_ref {
+    aabb box;
+    point3 centroid;
+    uint32_t index; // position in the caller's primitive array
+};
+
+// Below this depth the builder stops trusting SAH and splits at the median,
+// which bounds any tree to kBvhMaxSahDepth + 32 levels.
+constexpr int kBvhMaxSahDepth = 64;
+constexpr int kBvhMaxDepth = kBvhMaxSahDepth + 32;
+
+// Below this many primitives a range is always processed serially
+constexpr size_t kBvhParallelMinPrimitives = 8192;
+
+inline int bvh_build_threads(const bvh_build_options &options) {
+    if (options.num_threads > 0) {
+        return options.num_threads;
+    }
+    return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+// Threads available to a node at this depth: the top node gets all of
+// them, each level down splits them between the two subtrees
+inline int bvh_threads_at_depth(int threads, int depth) {
+    return depth < 31 ? std::max(1, threads >> depth) : 1;
+}
+
+// Runs fn(chunk_start, chunk_end, chunk) over [start, end) split into
+// `chunks` contiguous pieces, one thread each (the caller runs the first).
+// An exception from any chunk reaches the caller once all have stopped.
+template <typename F>
+void bvh_parallel_for(size_t start, size_t end, int chunks, F fn) {
+    const size_t count = end - start;
+    if (chunks <= 1 || count < kBvhParallelMinPrimitives) {
+        fn(start, end, 0);
+        return;
+    }
+    // Destroying a future from std::async waits for its thread, so an
+    // early exit still joins every worker
+    std::vector<std::future<void>> workers;
+    workers.reserve(chunks - 1);
+    for (int c = 1; c < chunks; ++c) {
+        workers.push_back(std::async(std::launch::async, fn,
+                                     start + count * c / chunks,
+                                     start + count * (c + 1) / chunks, c));
+    }
+    fn(start, start + count / chunks, 0);
+    for (auto &worker : workers) {
+        worker.get();
+    }
+}
+
+// Builder references for objects[start, end) with index = position in
+// objects. Every bounding box is computed exactly once, in parallel.
+inline std::vector<bvh_build_ref>
+make_bvh_refs(const std::vector<shared_ptr<hittable>> &objects, size_t start,
+              size_t end, double time0, double time1, int threads) {
+    std::vector<bvh_build_ref> refs(end - start);
+    std::atomic<bool> missing_box(false);
+    bvh_parallel_for(start, end, threads,
+                     [&](size_t chunk_start, size_t chunk_end, int) {
+                         for (size_t i = chunk_start; i < chunk_end; ++i) {
+                             bvh_build_ref &ref = refs[i - start];
+                             if (!objects[i]->bounding_box(time0, time1,
+                                                           ref.box)) {
+                                 missing_box = true;
+                             }
+                             ref.centroid =
+                                 0.5 * (ref.box.min() + ref.box.max());
+                             ref.index = static_cast<uint32_t>(i);
+                         }
+                     });
+    if (missing_box) {
+        // HARD-FAIL: BVH requires valid AABB for every primitive.
+        // This will tell you exactly which path is missing bounding_box().
+        throw std::runtime_error(
+            "BVH build error: object has no bounding box. "
+            "Implement bounding_box() for all hittables used in BVH.");
+    }
+    return refs;
+}
+
+inline double surface_area(const aabb &box) {
+    vec3 d = box.max() - box.min();
+    return 2.0 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+inline aabb empty_box() {
+    return aabb(point3(infinity, infinity, infinity),
+                point3(-infinity, -infinity, -infinity));
+}
+
+// In-place unions; cheaper than surrounding_box() in the build loops
+inline void grow(aabb &box, const point3 &p) {
+    for (int a = 0; a < 3; a++) {
+        box.minimum[a] = std::min(box.minimum[a], p[a]);
+        box.maximum[a] = std::max(box.maximum[a], p[a]);
+    }
+}
+
+inline void grow(aabb &box, const aabb &other) {
+    for (int a = 0; a < 3; a++) {
+        box.minimum[a] = std::min(box.minimum[a], other.minimum[a]);
+        box.maximum[a] = std::max(box.maximum[a], other.maximum[a]);
+    }
+}
+
+// Bounds of refs[start, end) and of their centroids
+inline void bvh_range_bounds(const std::vector<bvh_build_ref> &refs,
+                             size_t start, size_t end, aabb &bounds,
+                             aabb &centroid_bounds, int threads = 1) {
+    if (threads <= 1 || end - start < kBvhParallelMinPrimitives) {
+        bounds = empty_box();
+        centroid_bounds = empty_box();
+        for (size_t i = start; i < end; ++i) {
+            grow(bounds, refs[i].box);
+            grow(centroid_bounds, refs[i].centroid);
+        }
+        return;
+    }
+
+    std::vector<aabb> partial(2 * std::max(1, threads), empty_box());
+    bvh_parallel_for(start, end, threads,
+                     [&](size_t chunk_start, size_t chunk_end, int chunk) {
+                         aabb &b = partial[2 * chunk];
+                         aabb &c = partial[2 * chunk + 1];
+                         for (size_t i = chunk_start; i < chunk_end; ++i) {
+                             grow(b, refs[i].box);
+                             grow(c, refs[i].centroid);
+                         }
+                     });
+    bounds = empty_box();
+    centroid_bounds = empty_box();
+    for (size_t i = 0; i < partial.size(); i += 2) {
+        grow(bounds, partial[i]);
+        grow(centroid_bounds, partial[i + 1]);
+    }
+}
+
+struct bvh_bin {
+    aabb box = empty_box();
+    size_t count = 0;
+};
+
+// Bins the centroids of refs[start, end) on all three axes; bin b of axis
+// a is bins[a * bin_count + b]. Axes without extent are left empty.
+inline void bvh_bin_range(const std::vector<bvh_build_ref> &refs,
+                          size_t start, size_t end,
+                          const aabb &centroid_bounds, int bin_count,
+                          bvh_bin *bins) {
+    double scale[3];
+    for (int a = 0; a < 3; a++) {
+        double extent = centroid_bounds.max()[a] - centroid_bounds.min()[a];
+        scale[a] = extent > 0 ? bin_count / extent : 0.0;
+    }
+    for (int a = 0; a < 3; a++) {
+        if (scale[a] == 0.0) {
+            continue;
+        }
+        const double min = centroid_bounds.min()[a];
+        bvh_bin *axis_bins = bins + a * bin_count;
+        for (size_t i = start; i < end; ++i) {
+            int b = static_cast<int>((refs[i].centroid[a] - min) * scale[a]);
+            bvh_bin &bin = axis_bins[std::min(b, bin_count - 1)];
+            grow(bin.box, refs[i].box);
+            bin.count++;
+        }
+    }
+}
+
+// Chooses how to split refs[start, end) and partitions the range in place.
+// Returns the first index of the right half and its axis in split_axis, or
+// end if a leaf is cheaper (only when allow_leaf and the range fits in
+// options.max_leaf_size). Binning is spread over `threads` threads.
+inline size_t bvh_split(std::vector<bvh_build_ref> &refs, size_t start,
+                        size_t end, const aabb &bounds,
+                        const aabb &centroid_bounds,
+                        const bvh_build_options &options, bool allow_leaf,
+                        int depth, int &split_axis, int threads = 1) {
+    const size_t count = end - start;
+    const bool may_be_leaf =
+        allow_leaf && count <= static_cast<size_t>(options.max_leaf_size);
+    const int bins = std::max(2, options.bins);
+
+    std::vector<double> right_area(bins);
+    std::vector<size_t> right_count(bins);
+
+    double best_cost = infinity;
+    int best_axis = -1;
+    int best_plane = 0;
+
+    const vec3 extent = centroid_bounds.max() - centroid_bounds.min();
+    if (depth < kBvhMaxSahDepth) {
+        const int chunks =
+            count >= kBvhParallelMinPrimitives ? std::max(1, threads) : 1;
+        std::vector<bvh_bin> chunk_bins(static_cast<size_t>(chunks) * 3 *
+                                        bins);
+        bvh_parallel_for(start, end, chunks,
+                         [&](size_t chunk_start, size_t chunk_end, int chunk) {
+                             bvh_bin_range(refs, chunk_start, chunk_end,
+                                           centroid_bounds, bins,
+                                           &chunk_bins[chunk * 3 * bins]);
+                         });
+        for (int chunk = 1; chunk < chunks; ++chunk) {
+            for (int b = 0; b < 3 * bins; ++b) {
+                const bvh_bin &from = chunk_bins[chunk * 3 * bins + b];
+                grow(chunk_bins[b].box, from.box);
+                chunk_bins[b].count += from.count;
+            }
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            if (extent[axis] <= 0) {
+                continue;
+            }
+            const bvh_bin *bin_data = &chunk_bins[axis * bins];
+
+            // Sweep from the right, then evaluate every plane from the left
+            aabb box = empty_box();
+            size_t n = 0;
+            for (int b = bins - 1; b > 0; --b) {
+                grow(box, bin_data[b].box);
+                n += bin_data[b].count;
+                right_area[b] = n ? surface_area(box) : 0.0;
+                right_count[b] = n;
+            }
+            box = empty_box();
+            n = 0;
+            for (int plane = 1; plane < bins; ++plane) {
+                grow(box, bin_data[plane - 1].box);
+                n += bin_data[plane - 1].count;
+                if (n == 0 || right_count[plane] == 0) {
+                    continue;
+                }
+                double cost = surface_area(box) * n +
+                              right_area[plane] * right_count[plane];
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_plane = plane;
+                }
+            }
+        }
+    }
+
+    if (best_axis >= 0) {
+        double area = surface_area(bounds);
+        double split_cost =
+            options.traversal_cost +
+            options.intersection_cost * (area > 0 ? best_cost / area : count);
+        if (may_be_leaf && options.intersection_cost * count <= split_cost) {
+            return end;
+        }
+
+        const int axis = best_axis;
+        split_axis = axis;
+        const double scale = bins / extent[axis];
+        const double min = centroid_bounds.min()[axis];
+        auto middle = std::partition(
+            refs.begin() + start, refs.begin() + end,
+            [=](const bvh_build_ref &ref) {
+                int b = static_cast<int>((ref.centroid[axis] - min) * scale);
+                return std::min(b, bins - 1) < best_plane;
+            });
+        return static_cast<size_t>(middle - refs.begin());
+    }
+
+    // No useful plane (coincident centroids or too deep): median split
+    if (may_be_leaf) {
+        return end;
+    }
+    int axis = 0;
+    if (extent.y() > extent.x() && extent.y() > extent.z()) {
+        axis = 1;
+    } else if (extent.z() > extent.x()) {
+        axis = 2;
+    }
+    split_axis = axis;
+    const size_t mid = start + count / 2;
+    std::nth_element(refs.begin() + start, refs.begin() + mid,
+                     refs.begin() + end,
+                     [axis](const bvh_build_ref &a, const bvh_build_ref &b) {
+                         return a.centroid[axis] < b.centroid[axis];
+                     });
+    return mid;
+}
+
+#endif
@@ -52,18 +52,19 @@ class constant_medium : public hittable {
     double neg_inv_density;
 };
 
-bool constant_medium::hit(const ray &r, double t_min, double t_max,
-                          hit_record &rec) const {
+inline bool constant_medium::hit(const ray &r, double t_min, double t_max,
+                                 hit_record &rec) const {
     // Print occasional samples when debugging. To enable, set enableDebug true.
     const bool enableDebug = false;
     const bool debugging = enableDebug && random_double() < 0.00001;
 
     hit_record rec1, rec2;
 
-    if (!boundary->hit(r, -infinity, infinity, rec1))
+    // Only t is needed from the boundary
+    if (!boundary->intersect(r, -infinity, infinity, rec1))
         return false;
 
-    if (!boundary->hit(r, rec1.t + 0.0001, infinity, rec2))
+    if (!boundary->intersect(r, rec1.t + 0.0001, infinity, rec2))
         return false;
 
     if (debugging)
@@ -6,6 +6,10 @@
 #include "rtweekend.h"
 
 class material;
+class hittable;
+
+// Transforms a deferred hit can pass through before it is finished
+constexpr int kMaxDeferredTransforms = 4;
 
 struct hit_record {
     point3 p;
@@ -16,6 +20,15 @@ struct hit_record {
     double v;
     bool front_face;
 
+    // Left by hittable::intersect until finish_hit() runs: the primitive
+    // hit (nullptr once the fields above are set), which of its parts, and
+    // the transforms on the way to it, innermost first. Meanwhile u and v
+    // hold the primitive's own hit coordinates (barycentrics for triangles).
+    const hittable *object;
+    uint32_t primitive;
+    int transform_count;
+    const hittable *transforms[kMaxDeferredTransforms];
+
     inline void set_face_normal(const ray &r, const vec3 &outWard_normal) {
         front_face = dot(r.direction(), outWard_normal) < 0;
         normal = front_face ? outWard_normal : -outWard_normal;
@@ -29,8 +42,79 @@ class hittable {
                      hit_record &rec) const = 0;
     virtual bool bounding_box(double time0, double time1,
                               aabb &output_box) const = 0;
+
+    // Any-hit query for shadow rays: true if something lies in
+    // (t_min, t_max). Overrides stop at the first hit they find and skip
+    // the normal, UV and material; this fallback finds the closest one.
+    virtual bool occluded(const ray &r, double t_min, double t_max) const {
+        hit_record rec;
+        return hit(r, t_min, t_max, rec);
+    }
+
+    // Closest hit like hit(), but only t and what surface() needs are
+    // recorded, so hits that a closer one replaces during traversal cost
+    // no normals, UVs or transcendentals; finish_hit() completes the one
+    // that is kept. rec is only written on success. This fallback does the
+    // whole hit() right away.
+    virtual bool intersect(const ray &r, double t_min, double t_max,
+                           hit_record &rec) const {
+        if (!hit(r, t_min, t_max, rec)) {
+            return false;
+        }
+        rec.object = nullptr;
+        rec.transform_count = 0;
+        return true;
+    }
+
+    // Point, normal, UV and material of a hit that intersect() recorded on
+    // this primitive, for the ray in the primitive's space
+    virtual void surface(const ray & /*r*/, hit_record & /*rec*/) const {
+    }
+
+    // Transforms: the ray in the wrapped object's space, and a finished
+    // hit taken back out of it (r is the ray outside)
+    virtual ray to_local(const ray &r) const {
+        return r;
+    }
+    virtual void to_world(const ray & /*r*/, hit_record & /*rec*/) const {
+    }
 };
 
+// Evaluates what intersect() deferred: the primitive's surface in its own
+// space, then each transform on the way out
+inline void finish_hit(const ray &r, hit_record &rec) {
+    const int n = rec.transform_count;
+    if (n == 0) {
+        if (rec.object) {
+            rec.object->surface(r, rec);
+        }
+    } else {
+        ray rays[kMaxDeferredTransforms + 1];
+        rays[n] = r;
+        for (int k = n - 1; k >= 0; k--) {
+            rays[k] = rec.transforms[k]->to_local(rays[k + 1]);
+        }
+        if (rec.object) {
+            rec.object->surface(rays[0], rec);
+        }
+        for (int k = 0; k < n; k++) {
+            rec.transforms[k]->to_world(rays[k + 1], rec);
+        }
+    }
+    rec.object = nullptr;
+    rec.transform_count = 0;
+}
+
+// Records that a deferred hit came through transform, whose wrapped object
+// saw the ray as local. A full stack is finished first.
+inline void push_transform(const hittable *transform, const ray &local,
+                           hit_record &rec) {
+    if (rec.transform_count == kMaxDeferredTransforms) {
+        finish_hit(local, rec);
+    }
+    rec.transforms[rec.transform_count++] = transform;
+}
+
 class translate : public hittable {
   public:
     translate(shared_ptr<hittable> p, const vec3 &displacement)
@@ -43,6 +127,29 @@ class translate : public hittable {
     virtual bool bounding_box(double time0, double time1,
                               aabb &output_box) const override;
 
+    virtual bool occluded(const ray &r, double t_min,
+                          double t_max) const override {
+        return ptr->occluded(to_local(r), t_min, t_max);
+    }
+
+    virtual bool intersect(const ray &r, double t_min, double t_max,
+                           hit_record &rec) const override {
+        ray moved_r = to_local(r);
+        if (!ptr->intersect(moved_r, t_min, t_max, rec)) {
+            return false;
+        }
+        push_transform(this, moved_r, rec);
+        return true;
+    }
+
+    virtual ray to_local(const ray &r) const override {
+        return ray(r.origin() - offset, r.direction(), r.time());
+    }
+
+    virtual void to_world(const ray & /*r*/, hit_record &rec) const override {
+        rec.p += offset;
+    }
+
   public:
     shared_ptr<hittable> ptr;
     vec3 offset;
@@ -50,13 +157,10 @@ class translate : public hittable {
 
 inline bool translate::hit(const ray &r, double t_min, double t_max,
                            hit_record &rec) const {
-    ray moved_r(r.origin() - offset, r.direction(), r.time());
-    if (!ptr->hit(moved_r, t_min, t_max, rec)) {
+    if (!intersect(r, t_min, t_max, rec)) {
         return false;
     }
-
-    rec.p += offset;
-
+    finish_hit(r, rec);
     return true;
 }
 
@@ -84,6 +188,24 @@ class rotate_y : public hittable {
         return hasbox;
     }
 
+    virtual bool occluded(const ray &r, double t_min,
+                          double t_max) const override {
+        return ptr->occluded(to_local(r), t_min, t_max);
+    }
+
+    virtual bool intersect(const ray &r, double t_min, double t_max,
+                           hit_record &rec) const override {
+        ray rotated_r = to_local(r);
+        if (!ptr->intersect(rotated_r, t_min, t_max, rec)) {
+            return false;
+        }
+        push_transform(this, rotated_r, rec);
+        return true;
+    }
+
+    virtual ray to_local(const ray &r) const override;
+    virtual void to_world(const ray &r, hit_record &rec) const override;
+
   public:
     shared_ptr<hittable> ptr;
     double sin_theta;
@@ -123,8 +245,7 @@ inline rotate_y::rotate_y(shared_ptr<hittable> p, double angle) : ptr(p) {
     bbox = aabb(min, max);
 }
 
-inline bool rotate_y::hit(const ray &r, double t_min, double t_max,
-                          hit_record &rec) const {
+inline ray rotate_y::to_local(const ray &r) const {
     auto origin = r.origin();
     auto direction = r.direction();
 
@@ -134,11 +255,18 @@ inline bool rotate_y::hit(const ray &r, double t_min, double t_max,
     direction[0] = cos_theta * r.direction()[0] - sin_theta * r.direction()[2];
     direction[2] = sin_theta * r.direction()[0] + cos_theta * r.direction()[2];
 
-    ray rotated_r(origin, direction, r.time());
+    return ray(origin, direction, r.time());
+}
 
-    if (!ptr->hit(rotated_r, t_min, t_max, rec))
+inline bool rotate_y::hit(const ray &r, double t_min, double t_max,
+                          hit_record &rec) const {
+    if (!intersect(r, t_min, t_max, rec))
         return false;
+    finish_hit(r, rec);
+    return true;
+}
 
+inline void rotate_y::to_world(const ray &r, hit_record &rec) const {
     auto p = rec.p;
     auto normal = rec.normal;
 
@@ -150,7 +278,6 @@ inline bool rotate_y::hit(const ray &r, double t_min, double t_max,
 
     rec.p = p;
     rec.set_face_normal(r, normal);
-    return true;
 }
 
 class flip_face : public hittable {
@@ -159,10 +286,21 @@ class flip_face : public hittable {
 
     virtual bool hit(const ray& r, double t_min, double t_max,
                      hit_record& rec) const override {
-        if (!ptr->hit(r, t_min, t_max, rec)) return false;
+        if (!intersect(r, t_min, t_max, rec)) return false;
+        finish_hit(r, rec);
+        return true;
+    }
+
+    virtual bool intersect(const ray& r, double t_min, double t_max,
+                           hit_record& rec) const override {
+        if (!ptr->intersect(r, t_min, t_max, rec)) return false;
+        push_transform(this, r, rec);
+        return true;
+    }
+
+    virtual void to_world(const ray& /*r*/, hit_record& rec) const override {
         rec.front_face = !rec.front_face;
         rec.normal = -rec.normal;
-        return true;
     }
 
     virtual bool bounding_box(double time0, double time1,
@@ -170,6 +308,11 @@ class flip_face : public hittable {
         return ptr->bounding_box(time0, time1, output_box);
     }
 
+    virtual bool occluded(const ray& r, double t_min,
+                          double t_max) const override {
+        return ptr->occluded(r, t_min, t_max);
+    }
+
   public:
     shared_ptr<hittable> ptr;
 };
@@ -23,31 +23,51 @@ class hittable_list : public hittable {
     virtual bool hit(const ray &r, double t_min, double t_max,
                      hit_record &rec) const override;
 
+    virtual bool intersect(const ray &r, double t_min, double t_max,
+                           hit_record &rec) const override;
+
     virtual bool bounding_box(double time0, double time1,
                               aabb &output_box) const override;
 
+    virtual bool occluded(const ray &r, double t_min,
+                          double t_max) const override {
+        for (const auto &object : objects) {
+            if (object->occluded(r, t_min, t_max)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
   public:
     std::vector<shared_ptr<hittable>> objects;
 };
 
-bool hittable_list::hit(const ray &r, double t_min, double t_max,
-                        hit_record &rec) const {
-    hit_record temp_rec;
+inline bool hittable_list::hit(const ray &r, double t_min, double t_max,
+                               hit_record &rec) const {
+    if (!intersect(r, t_min, t_max, rec)) {
+        return false;
+    }
+    finish_hit(r, rec);
+    return true;
+}
+
+inline bool hittable_list::intersect(const ray &r, double t_min,
+                                     double t_max, hit_record &rec) const {
     bool hit_anything = false;
     auto closest_so_far = t_max;
 
     for (const auto &object : objects) {
-        if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+        if (object->intersect(r, t_min, closest_so_far, rec)) {
             hit_anything = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
+            closest_so_far = rec.t;
         }
     }
     return hit_anything;
 }
 
-bool hittable_list::bounding_box(double time0, double time1,
-                                 aabb &output_box) const {
+inline bool hittable_list::bounding_box(double time0, double time1,
+                                        aabb &output_box) const {
     if (objects.empty())
         return false;
 
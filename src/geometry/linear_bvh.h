@@ -0,0 +1,380 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "aligned_array.h"
+#include "bvh_build.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "primitive_store.h"
+#include "ray.h"
+#include "render_stats.h"
+#include "rtweekend.h"
+#include "vec3.h"
+
+// 32-byte node; two of them share a cache line. Nodes are stored in
+// depth-first order, so the first child of an interior node is always the
+// next node in the array and only the second child needs an index.
+struct linear_bvh_node {
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t offset;          // leaf: first primitive; interior: 2nd child
+    uint16_t primitive_count; // 0 for interior nodes
+    uint8_t axis;             // split axis of interior nodes
+    uint8_t pad;
+
+    bool is_leaf() const {
+        return primitive_count > 0;
+    }
+    aabb box() const {
+        return aabb(point3(bounds_min[0], bounds_min[1], bounds_min[2]),
+                    point3(bounds_max[0], bounds_max[1], bounds_max[2]));
+    }
+};
+
+static_assert(sizeof(linear_bvh_node) == 32,
+              "linear_bvh_node must be 32 bytes");
+
+// BVH flattened into one array of nodes and traversed with an explicit
+// stack instead of recursive virtual calls. Primitives are reordered so
+// every leaf references a contiguous range of them, and the common kinds
+// are intersected without a virtual call (primitive_store.h).
+class linear_bvh : public hittable {
+  public:
+    linear_bvh(const hittable_list &list, double time0, double time1,
+               const bvh_build_options &options = default_bvh_build_options())
+        : linear_bvh(list.objects, time0, time1, options) {
+    }
+
+    linear_bvh(const std::vector<shared_ptr<hittable>> &src_objects,
+               double time0, double time1,
+               const bvh_build_options &options = default_bvh_build_options());
+
+    bool hit(const ray &r, double t_min, double t_max,
+             hit_record &rec) const override;
+
+    bool occluded(const ray &r, double t_min, double t_max) const override;
+
+    bool intersect(const ray &r, double t_min, double t_max,
+                   hit_record &rec) const override;
+
+    bool bounding_box(double time0, double time1,
+                      aabb &output_box) const override;
+
+    size_t node_count() const {
+        return nodes.size();
+    }
+
+    // Expected cost of a ray that hits the root box, in the units of the
+    // build options: node tests times traversal_cost plus primitive tests
+    // times intersection_cost, each weighted by its box's surface area
+    // relative to the root.
+    double sah_cost() const {
+        return m_sah_cost;
+    }
+
+    // Builds the nodes over refs, reordering refs so that every leaf covers
+    // the contiguous range [offset, offset + primitive_count) of it. Also
+    // used by wide_bvh, which collapses the binary tree.
+    static void build_nodes(std::vector<bvh_build_ref> &refs,
+                            const bvh_build_options &options,
+                            std::vector<linear_bvh_node> &out);
+
+    // sah_cost() of a tree made by build_nodes() whose exact bounds are
+    // root_box
+    static double nodes_sah_cost(const std::vector<linear_bvh_node> &nodes,
+                                 const aabb &root_box,
+                                 const bvh_build_options &options);
+
+    // Walks nodes front to back and calls leaf(first, count, t_max) for
+    // every leaf the ray reaches. leaf returns true if it hit something, in
+    // which case it has lowered t_max to the new closest distance. Lets
+    // primitives that are not hittables (triangle_mesh) share the traversal.
+    // AnyHit stops at the first leaf that reports a hit.
+    template <bool AnyHit = false, typename LeafFn>
+    static bool traverse(const linear_bvh_node *nodes, size_t node_count,
+                         const ray &r, double t_min, double t_max,
+                         LeafFn &&leaf);
+
+  private:
+    static uint32_t build(std::vector<bvh_build_ref> &refs, size_t start,
+                          size_t end, int depth, int threads,
+                          const bvh_build_options &options,
+                          std::vector<linear_bvh_node> &out);
+
+    static bool hit_node(const linear_bvh_node &node, const point3 &origin,
+                         const vec3 &inv_dir, const int *sign, double t_min,
+                         double t_max);
+
+    primitive_store primitives; // in leaf order
+    aligned_array<linear_bvh_node> nodes;
+    aabb box;
+    double m_sah_cost = 0.0;
+};
+
+inline bool linear_bvh::bounding_box(double /*time0*/, double /*time1*/,
+                                     aabb &output_box) const {
+    output_box = box;
+    return !nodes.empty();
+}
+
+// Slab test against the float bounds, evaluated in double precision
+inline bool linear_bvh::hit_node(const linear_bvh_node &node,
+                                 const point3 &origin, const vec3 &inv_dir,
+                                 const int *sign, double t_min,
+                                 double t_max) {
+    for (int a = 0; a < 3; a++) {
+        double t0 = (node.bounds_min[a] - origin[a]) * inv_dir[a];
+        double t1 = (node.bounds_max[a] - origin[a]) * inv_dir[a];
+        if (sign[a]) {
+            std::swap(t0, t1);
+        }
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+        if (t_max <= t_min) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool linear_bvh::hit(const ray &r, double t_min, double t_max,
+                            hit_record &rec) const {
+    if (!intersect(r, t_min, t_max, rec)) {
+        return false;
+    }
+    finish_hit(r, rec);
+    return true;
+}
+
+inline bool linear_bvh::intersect(const ray &r, double t_min, double t_max,
+                                  hit_record &rec) const {
+    return traverse(nodes.data(), nodes.size(), r, t_min, t_max,
+                    [&](uint32_t first, uint32_t count, double &t_closest) {
+                        bool hit_leaf = false;
+                        for (uint32_t i = first; i < first + count; ++i) {
+                            if (primitives.intersect(i, r, t_min, t_closest,
+                                                     rec)) {
+                                hit_leaf = true;
+                                t_closest = rec.t;
+                            }
+                        }
+                        return hit_leaf;
+                    });
+}
+
+inline bool linear_bvh::occluded(const ray &r, double t_min,
+                                 double t_max) const {
+    auto leaf = [&](uint32_t first, uint32_t count, double & /*t_max*/) {
+        for (uint32_t i = first; i < first + count; ++i) {
+            if (primitives.occluded(i, r, t_min, t_max)) {
+                return true;
+            }
+        }
+        return false;
+    };
+    return traverse<true>(nodes.data(), nodes.size(), r, t_min, t_max, leaf);
+}
+
+template <bool AnyHit, typename LeafFn>
+bool linear_bvh::traverse(const linear_bvh_node *nodes, size_t node_count,
+                          const ray &r, double t_min, double t_max,
+                          LeafFn &&leaf) {
+    if (node_count == 0) {
+        return false;
+    }
+
+    const point3 origin = r.origin();
+    const vec3 inv_dir = r.inv_direction();
+    const int *sign = r.direction_sign();
+
+    uint32_t stack[kBvhMaxDepth];
+    int stack_size = 0;
+    uint32_t current = 0;
+    bool hit_anything = false;
+    long long visited = 0;
+    long long tested = 0;
+
+    while (true) {
+        const linear_bvh_node &node = nodes[current];
+        ++visited;
+        if (hit_node(node, origin, inv_dir, sign, t_min, t_max)) {
+            if (node.is_leaf()) {
+                tested += node.primitive_count;
+                if (leaf(node.offset, node.primitive_count, t_max)) {
+                    hit_anything = true;
+                    if (AnyHit) {
+                        break;
+                    }
+                }
+            } else if (sign[node.axis]) {
+                // Ray points down the split axis: the second child is nearer
+                stack[stack_size++] = current + 1;
+                current = node.offset;
+                continue;
+            } else {
+                stack[stack_size++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+        if (stack_size == 0) {
+            break;
+        }
+        current = stack[--stack_size];
+    }
+    RT_STAT_ADD(kBvhNodesVisited, visited);
+    RT_STAT_ADD(kPrimitiveTests, tested);
+    return hit_anything;
+}
+
+inline linear_bvh::linear_bvh(
+    const std::vector<shared_ptr<hittable>> &src_objects, double time0,
+    double time1, const bvh_build_options &options) {
+    bvh_build_timer timer;
+    if (src_objects.empty()) {
+        return;
+    }
+
+    std::vector<bvh_build_ref> refs =
+        make_bvh_refs(src_objects, 0, src_objects.size(), time0, time1,
+                      bvh_build_threads(options));
+
+    std::vector<linear_bvh_node> built;
+    build_nodes(refs, options, built);
+
+    std::vector<shared_ptr<hittable>> ordered;
+    ordered.reserve(refs.size());
+    for (const auto &ref : refs) {
+        ordered.push_back(src_objects[ref.index]);
+    }
+    primitives = primitive_store(std::move(ordered));
+
+    nodes.resize(built.size());
+    std::copy(built.begin(), built.end(), nodes.begin());
+
+    // Exact bounds rather than the rounded root node, so callers placing
+    // objects by their box see the same numbers as with bvh_node
+    box = refs[0].box;
+    for (const auto &ref : refs) {
+        box = surrounding_box(box, ref.box);
+    }
+
+    m_sah_cost = nodes_sah_cost(built, box, options);
+}
+
+inline double
+linear_bvh::nodes_sah_cost(const std::vector<linear_bvh_node> &nodes,
+                           const aabb &root_box,
+                           const bvh_build_options &options) {
+    double root_area = surface_area(root_box);
+    double total = 0.0;
+    for (const auto &node : nodes) {
+        aabb node_box = node.box();
+        double cost = options.traversal_cost +
+                      options.intersection_cost * node.primitive_count;
+        total += root_area > 0 ? cost * surface_area(node_box) / root_area
+                               : cost;
+    }
+    return total;
+}
+
+inline void linear_bvh::build_nodes(std::vector<bvh_build_ref> &refs,
+                                    const bvh_build_options &options,
+                                    std::vector<linear_bvh_node> &out) {
+    out.clear();
+    if (refs.empty()) {
+        return;
+    }
+    out.reserve(2 * refs.size());
+    build(refs, 0, refs.size(), 0, bvh_build_threads(options), options, out);
+}
+
+// Builds the subtree over refs[start, end) in depth-first order, appending
+// to out, and returns the index of its root. While threads are left, the
+// second subtree is built concurrently into its own array and appended
+// afterwards.
+inline uint32_t linear_bvh::build(std::vector<bvh_build_ref> &refs,
+                                  size_t start, size_t end, int depth,
+                                  int threads,
+                                  const bvh_build_options &options,
+                                  std::vector<linear_bvh_node> &out) {
+    const int node_threads = bvh_threads_at_depth(threads, depth);
+    aabb bounds, centroid_bounds;
+    bvh_range_bounds(refs, start, end, bounds, centroid_bounds, node_threads);
+
+    const uint32_t index = static_cast<uint32_t>(out.size());
+    out.emplace_back();
+    {
+        // Round outwards so the float box still contains the double one
+        constexpr float kInf = std::numeric_limits<float>::infinity();
+        linear_bvh_node &node = out.back();
+        for (int a = 0; a < 3; a++) {
+            float lo = static_cast<float>(bounds.min()[a]);
+            float hi = static_cast<float>(bounds.max()[a]);
+            if (lo > bounds.min()[a]) {
+                lo = std::nextafter(lo, -kInf);
+            }
+            if (hi < bounds.max()[a]) {
+                hi = std::nextafter(hi, kInf);
+            }
+            node.bounds_min[a] = lo;
+            node.bounds_max[a] = hi;
+        }
+    }
+
+    // The leaf size must fit in primitive_count
+    bvh_build_options leaf_options = options;
+    leaf_options.max_leaf_size =
+        std::min(std::max(1, options.max_leaf_size), 255);
+
+    int axis = 0;
+    const size_t mid =
+        bvh_split(refs, start, end, bounds, centroid_bounds, leaf_options,
+                  true, depth, axis, node_threads);
+    if (mid == end) {
+        out[index].offset = static_cast<uint32_t>(start);
+        out[index].primitive_count = static_cast<uint16_t>(end - start);
+        return index;
+    }
+
+    uint32_t second;
+    if (node_threads > 1 && end - mid >= kBvhParallelMinPrimitives) {
+        // Declared after second_nodes: if the first build throws, the
+        // future waits for the worker before the vector goes away
+        std::vector<linear_bvh_node> second_nodes;
+        std::future<void> worker = std::async(std::launch::async, [&] {
+            second_nodes.reserve(2 * (end - mid));
+            build(refs, mid, end, depth + 1, threads, options, second_nodes);
+        });
+        build(refs, start, mid, depth + 1, threads, options, out);
+        worker.get();
+
+        // Child indices inside second_nodes are relative to its start
+        second = static_cast<uint32_t>(out.size());
+        for (auto &node : second_nodes) {
+            if (!node.is_leaf()) {
+                node.offset += second;
+            }
+        }
+        out.insert(out.end(), second_nodes.begin(), second_nodes.end());
+    } else {
+        build(refs, start, mid, depth + 1, threads, options, out);
+        second = build(refs, mid, end, depth + 1, threads, options, out);
+    }
+
+    // out may have reallocated, so only index it from here on
+    out[index].offset = second;
+    out[index].primitive_count = 0;
+    out[index].axis = static_cast<uint8_t>(axis);
+    return index;
+}
+
+#endif // LINEAR_BVH_H
@@ -1,17 +1,23 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
-#include "bvh.h"
+#include "accelerator.h"
 #include "hittable.h"
 #include "hittable_list.h"
 #include "material.h"
-#include "tiny_obj_loader.h"
+#include "mesh_cache.h"
+#include "obj_parser.h"
+#include "process_stats.h"
+#include "trace.h"
 #include "triangle.h"
+#include "triangle_mesh.h"
 
 class mesh : public hittable {
   public:
@@ -21,8 +27,7 @@ class mesh : public hittable {
          double time1 = 1.0, bool build_bvh = true)
         : triangles(std::move(faces)) {
         if (build_bvh) {
-            accelerator = make_shared<bvh_node>(triangles, 0, triangles.size(),
-                                                time0, time1);
+            accelerator = make_accelerator(triangles, time0, time1);
         } else {
             auto list = make_shared<hittable_list>();
             for (auto &tri : triangles) {
@@ -32,6 +37,15 @@ class mesh : public hittable {
         }
     }
 
+    // Indexed triangles loaded from an OBJ file
+    explicit mesh(shared_ptr<triangle_mesh> surface)
+        : accelerator(std::move(surface)) {
+    }
+
+    // Loads an OBJ file into a triangle_mesh (shared vertex arrays, one
+    // index buffer) with p * scale + translation applied to every vertex.
+    // The result is cached in "<filename>.meshcache" and mapped on the
+    // next load while the OBJ and the parameters are unchanged.
     static shared_ptr<mesh>
     load_from_obj(const std::string &filename, shared_ptr<material> mat,
                   const vec3 &translation = vec3(0, 0, 0),
@@ -43,6 +57,15 @@ class mesh : public hittable {
         return accelerator && accelerator->hit(r, t_min, t_max, rec);
     }
 
+    bool occluded(const ray &r, double t_min, double t_max) const override {
+        return accelerator && accelerator->occluded(r, t_min, t_max);
+    }
+
+    bool intersect(const ray &r, double t_min, double t_max,
+                   hit_record &rec) const override {
+        return accelerator && accelerator->intersect(r, t_min, t_max, rec);
+    }
+
     bool bounding_box(double time0, double time1,
                       aabb &output_box) const override {
         if (!accelerator) {
@@ -60,114 +83,177 @@ inline shared_ptr<mesh>
 mesh::load_from_obj(const std::string &filename, shared_ptr<material> mat,
                     const vec3 &translation, const vec3 &scale,
                     bool build_bvh, bool use_vertex_normals) {
-    tinyobj::ObjReaderConfig reader_config;
-    reader_config.triangulate = true;
+    mesh_cache_key cache_key;
+    const std::string cache_path = mesh_cache_path(filename);
+    const bool cacheable =
+        mesh_cache_enabled() &&
+        make_mesh_cache_key(filename, translation, scale, build_bvh,
+                            use_vertex_normals, default_bvh_build_options(),
+                            cache_key);
+    if (cacheable) {
+        auto cache_start = std::chrono::steady_clock::now();
+        auto cached = read_mesh_cache(cache_path, cache_key, mat);
+        if (cached) {
+            auto cache_end = std::chrono::steady_clock::now();
+            record_trace_event("read_mesh_cache", "scene", cache_start,
+                               cache_end, trace_arg("file", cache_path));
+            std::chrono::duration<double> cache_time = cache_end - cache_start;
+            std::clog << "[Mesh] " << filename << ": loaded from cache in "
+                      << cache_time.count() << " s, "
+                      << cached->triangle_count() << " triangles, "
+                      << cached->vertex_count() << " vertices" << std::endl;
+            return make_shared<mesh>(cached);
+        }
+    }
 
-    tinyobj::ObjReader reader;
-    if (!reader.ParseFromFile(filename, reader_config)) {
-        std::cerr << "[TinyObjLoader] " << reader.Error() << std::endl;
+    auto parse_start = std::chrono::steady_clock::now();
+    obj_data obj;
+    std::string error;
+    if (!parse_obj(filename, obj, error)) {
+        std::cerr << "[OBJ] " << error << std::endl;
         return nullptr;
     }
+    auto parse_end = std::chrono::steady_clock::now();
+    record_trace_event("parse_obj", "scene", parse_start, parse_end,
+                       trace_arg("file", filename));
+    std::chrono::duration<double> parse_time = parse_end - parse_start;
 
-    const auto &attrib = reader.GetAttrib();
-    const auto &shapes = reader.GetShapes();
+    const size_t position_count = obj.positions.size() / 3;
+    const size_t normal_count = obj.normals.size() / 3;
+    const size_t texcoord_count = obj.texcoords.size() / 2;
 
-    std::vector<shared_ptr<hittable>> faces;
-    faces.reserve(shapes.size() * 3);
+    triangle_mesh_buffers buffers;
+    buffers.scale = scale;
+    buffers.translation = translation;
 
-    for (const auto &shape : shapes) {
-        size_t index_offset = 0;
-        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
-            int fv = shape.mesh.num_face_vertices[f];
-            if (fv != 3) {
-                index_offset += fv;
-                continue;
-            }
+    auto valid_normal = [&](const obj_corner &corner) {
+        if (corner.normal < 0 ||
+            static_cast<size_t>(corner.normal) >= normal_count) {
+            return false;
+        }
+        const float *n = &obj.normals[3 * static_cast<size_t>(corner.normal)];
+        return n[0] != 0 || n[1] != 0 || n[2] != 0;
+    };
+    auto valid_texcoord = [&](const obj_corner &corner) {
+        return corner.texcoord >= 0 &&
+               static_cast<size_t>(corner.texcoord) < texcoord_count;
+    };
 
-            tinyobj::index_t idx0 = shape.mesh.indices[index_offset + 0];
-            tinyobj::index_t idx1 = shape.mesh.indices[index_offset + 1];
-            tinyobj::index_t idx2 = shape.mesh.indices[index_offset + 2];
-            index_offset += 3;
+    // OBJ indexes positions, normals and UVs separately; every distinct
+    // combination used by a corner becomes one mesh vertex
+    std::unordered_map<obj_corner, uint32_t, obj_corner_hash> vertex_ids;
+    vertex_ids.reserve(position_count);
+    buffers.x.reserve(position_count);
+    buffers.y.reserve(position_count);
+    buffers.z.reserve(position_count);
+    auto vertex_id = [&](const obj_corner &corner) {
+        obj_corner key{corner.vertex,
+                       valid_normal(corner) ? corner.normal : -1,
+                       valid_texcoord(corner) ? corner.texcoord : -1};
+        auto found = vertex_ids.find(key);
+        if (found != vertex_ids.end()) {
+            return found->second;
+        }
+        const uint32_t id = static_cast<uint32_t>(buffers.x.size());
+        vertex_ids.emplace(key, id);
 
-            if (idx0.vertex_index < 0 || idx1.vertex_index < 0 ||
-                idx2.vertex_index < 0) {
-                continue;
-            }
+        const float *p = &obj.positions[3 * static_cast<size_t>(key.vertex)];
+        buffers.x.push_back(p[0]);
+        buffers.y.push_back(p[1]);
+        buffers.z.push_back(p[2]);
+        if (key.normal >= 0) {
+            const float *n = &obj.normals[3 * static_cast<size_t>(key.normal)];
+            buffers.nx.push_back(n[0]);
+            buffers.ny.push_back(n[1]);
+            buffers.nz.push_back(n[2]);
+        } else {
+            buffers.nx.push_back(0.0f);
+            buffers.ny.push_back(0.0f);
+            buffers.nz.push_back(0.0f);
+        }
+        if (key.texcoord >= 0) {
+            const float *t =
+                &obj.texcoords[2 * static_cast<size_t>(key.texcoord)];
+            buffers.u.push_back(t[0]);
+            buffers.v.push_back(t[1]);
+        } else {
+            buffers.u.push_back(0.0f);
+            buffers.v.push_back(0.0f);
+        }
+        return id;
+    };
 
-            auto fetch_vertex = [&](const tinyobj::index_t &idx) {
-                if (idx.vertex_index < 0 ||
-                    attrib.vertices.size() <=
-                        static_cast<size_t>(3 * idx.vertex_index + 2)) {
-                    return point3(0, 0, 0);
-                }
-                size_t v_base = static_cast<size_t>(3 * idx.vertex_index);
-                point3 p(attrib.vertices[v_base + 0], attrib.vertices[v_base + 1],
-                         attrib.vertices[v_base + 2]);
-                p[0] = p.x() * scale.x() + translation.x();
-                p[1] = p.y() * scale.y() + translation.y();
-                p[2] = p.z() * scale.z() + translation.z();
-                return p;
-            };
-
-            auto fetch_normal = [&](const tinyobj::index_t &idx) {
-                if (idx.normal_index < 0 ||
-                    attrib.normals.size() <=
-                        static_cast<size_t>(3 * idx.normal_index + 2)) {
-                    return vec3(0, 0, 0);
-                }
-                size_t n_base = static_cast<size_t>(3 * idx.normal_index);
-                return vec3(attrib.normals[n_base + 0], attrib.normals[n_base + 1],
-                            attrib.normals[n_base + 2]);
-            };
-
-            auto fetch_texcoord = [&](const tinyobj::index_t &idx, bool &valid) {
-                if (idx.texcoord_index < 0 ||
-                    attrib.texcoords.size() <=
-                        static_cast<size_t>(2 * idx.texcoord_index + 1)) {
-                    valid = false;
-                    return vec2(0, 0);
-                }
-                valid = true;
-                size_t t_base = static_cast<size_t>(2 * idx.texcoord_index);
-                return vec2(attrib.texcoords[t_base + 0],
-                            attrib.texcoords[t_base + 1]);
-            };
-
-            point3 p0 = fetch_vertex(idx0);
-            point3 p1 = fetch_vertex(idx1);
-            point3 p2 = fetch_vertex(idx2);
-
-            vec3 n0 = fetch_normal(idx0);
-            vec3 n1 = fetch_normal(idx1);
-            vec3 n2 = fetch_normal(idx2);
-
-            bool uv0_valid = false, uv1_valid = false, uv2_valid = false;
-            vec2 uv0 = fetch_texcoord(idx0, uv0_valid);
-            vec2 uv1 = fetch_texcoord(idx1, uv1_valid);
-            vec2 uv2 = fetch_texcoord(idx2, uv2_valid);
-
-            bool has_uvs = uv0_valid && uv1_valid && uv2_valid;
-
-            if (use_vertex_normals && n0.length_squared() > 0 &&
-                n1.length_squared() > 0 &&
-                n2.length_squared() > 0) {
-                faces.push_back(make_shared<triangle>(p0, p1, p2, unit_vector(n0),
-                                                      unit_vector(n1), unit_vector(n2),
-                                                      mat, uv0, uv1, uv2, has_uvs));
-            } else {
-                faces.push_back(
-                    make_shared<triangle>(p0, p1, p2, mat, uv0, uv1, uv2, has_uvs));
+    buffers.indices.reserve(obj.corners.size());
+    buffers.flags.reserve(obj.corners.size() / 3);
+    for (size_t c = 0; c + 2 < obj.corners.size(); c += 3) {
+        const obj_corner *corner = &obj.corners[c];
+        bool positions_valid = true;
+        for (int k = 0; k < 3; k++) {
+            if (corner[k].vertex < 0 ||
+                static_cast<size_t>(corner[k].vertex) >= position_count) {
+                positions_valid = false;
             }
         }
+        if (!positions_valid) {
+            continue;
+        }
+
+        uint8_t flags = 0;
+        if (use_vertex_normals && valid_normal(corner[0]) &&
+            valid_normal(corner[1]) && valid_normal(corner[2])) {
+            flags |= kMeshTriangleNormals;
+        }
+        if (valid_texcoord(corner[0]) && valid_texcoord(corner[1]) &&
+            valid_texcoord(corner[2])) {
+            flags |= kMeshTriangleUVs;
+        }
+        for (int k = 0; k < 3; k++) {
+            buffers.indices.push_back(vertex_id(corner[k]));
+        }
+        buffers.flags.push_back(flags);
     }
+    obj = obj_data(); // the mesh keeps its own copy
 
-    if (faces.empty()) {
-        std::cerr << "[TinyObjLoader] No valid triangles parsed from "
+    if (buffers.indices.empty()) {
+        std::cerr << "[OBJ] No valid triangles parsed from "
                   << filename << std::endl;
         return nullptr;
     }
 
-    return make_shared<mesh>(faces, 0.0, 1.0, build_bvh);
+    // Drop attribute arrays no triangle uses
+    uint8_t used = 0;
+    for (uint8_t flags : buffers.flags) {
+        used |= flags;
+    }
+    if (!(used & kMeshTriangleNormals)) {
+        buffers.nx = std::vector<float>();
+        buffers.ny = std::vector<float>();
+        buffers.nz = std::vector<float>();
+    }
+    if (!(used & kMeshTriangleUVs)) {
+        buffers.u = std::vector<float>();
+        buffers.v = std::vector<float>();
+    }
+
+    auto build_start = std::chrono::steady_clock::now();
+    auto surface =
+        make_shared<triangle_mesh>(std::move(buffers), mat, build_bvh);
+    std::chrono::duration<double> build_time =
+        std::chrono::steady_clock::now() - build_start;
+    std::clog << "[Mesh] " << filename << ": parsed in " << parse_time.count()
+              << " s, " << surface->triangle_count() << " triangles, "
+              << surface->vertex_count() << " vertices, "
+              << bytes_to_mb(surface->memory_bytes()) << " MB";
+    if (build_bvh) {
+        std::clog << ", BVH built in " << build_time.count()
+                  << " s, SAH cost " << surface->sah_cost();
+    }
+    std::clog << ", peak memory " << bytes_to_mb(peak_rss_bytes()) << " MB"
+              << std::endl;
+    if (cacheable && !write_mesh_cache(cache_path, cache_key, *surface)) {
+        std::clog << "[Mesh] Could not write " << cache_path << std::endl;
+    }
+    return make_shared<mesh>(surface);
 }
 
 #endif
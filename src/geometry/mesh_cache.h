@@ -0,0 +1,383 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "bvh_build.h"
+#include "linear_bvh.h"
+#include "mapped_file.h"
+#include "triangle_mesh.h"
+
+// Binary cache of a loaded OBJ mesh, written next to the source as
+// "<file>.meshcache": the triangle_mesh arrays in leaf order plus its BVH
+// nodes, each section 64-byte aligned so the mesh can use the mapped file
+// directly. A cache is only used when its version, the source file's size
+// and modification time and every load/build parameter match; otherwise
+// the OBJ is parsed again and the cache rewritten.
+
+constexpr char kMeshCacheMagic[8] = {'R', 'T', 'M', 'E', 'S', 'H', '\r', '\n'};
+// Bump when the layout or the meaning of any array changes
+constexpr uint32_t kMeshCacheVersion = 1;
+constexpr uint32_t kMeshCacheByteOrder = 0x01020304;
+constexpr uint64_t kMeshCacheAlignment = 64;
+
+// Used by mesh::load_from_obj; off makes it always parse the OBJ
+inline bool &mesh_cache_enabled() {
+    static bool enabled = true;
+    return enabled;
+}
+
+inline std::string mesh_cache_path(const std::string &source) {
+    return source + ".meshcache";
+}
+
+// Everything a cached mesh depends on besides the cache format
+struct mesh_cache_key {
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+    double scale[3];
+    double translation[3];
+    uint32_t use_vertex_normals;
+    uint32_t build_bvh;
+    int32_t bvh_bins;
+    int32_t bvh_max_leaf_size;
+    double bvh_traversal_cost;
+    double bvh_intersection_cost;
+};
+
+// Fills the source file part of key; false if it cannot be read
+inline bool mesh_cache_source_stamp(const std::string &source,
+                                    mesh_cache_key &key) {
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(source.c_str(), &info) != 0) {
+        return false;
+    }
+    key.source_mtime_ns = static_cast<int64_t>(info.st_mtime) * 1000000000;
+#else
+    struct stat info;
+    if (stat(source.c_str(), &info) != 0) {
+        return false;
+    }
+#ifdef __APPLE__
+    key.source_mtime_ns =
+        static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 +
+        info.st_mtimespec.tv_nsec;
+#else
+    key.source_mtime_ns =
+        static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+        info.st_mtim.tv_nsec;
+#endif
+#endif
+    key.source_size = static_cast<uint64_t>(info.st_size);
+    return true;
+}
+
+inline bool make_mesh_cache_key(const std::string &source,
+                                const vec3 &translation, const vec3 &scale,
+                                bool build_bvh, bool use_vertex_normals,
+                                const bvh_build_options &options,
+                                mesh_cache_key &key) {
+    std::memset(&key, 0, sizeof(key)); // padding takes part in comparisons
+    if (!mesh_cache_source_stamp(source, key)) {
+        return false;
+    }
+    for (int a = 0; a < 3; a++) {
+        key.scale[a] = scale[a];
+        key.translation[a] = translation[a];
+    }
+    key.use_vertex_normals = use_vertex_normals ? 1 : 0;
+    key.build_bvh = build_bvh ? 1 : 0;
+    key.bvh_bins = options.bins;
+    key.bvh_max_leaf_size = options.max_leaf_size;
+    key.bvh_traversal_cost = options.traversal_cost;
+    key.bvh_intersection_cost = options.intersection_cost;
+    return true;
+}
+
+namespace mesh_cache_detail {
+
+enum section {
+    kX,
+    kY,
+    kZ,
+    kNormalX,
+    kNormalY,
+    kNormalZ,
+    kU,
+    kV,
+    kIndices,
+    kFlags,
+    kNodes,
+    kSectionCount
+};
+
+struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t node_size; // sizeof(linear_bvh_node)
+    uint32_t has_normals;
+    uint32_t has_uvs;
+    uint32_t pad;
+    uint64_t vertex_count;
+    uint64_t triangle_count;
+    uint64_t node_count;
+    uint64_t file_size;
+    double box_min[3];
+    double box_max[3];
+    double sah_cost;
+    mesh_cache_key key;
+    uint64_t offset[kSectionCount]; // from the start of the file, 0: absent
+    uint64_t size[kSectionCount];   // in bytes
+};
+
+inline uint64_t align_up(uint64_t offset) {
+    return (offset + kMeshCacheAlignment - 1) & ~(kMeshCacheAlignment - 1);
+}
+
+// Name for a new cache file that no other writer uses: several processes
+// (or loader threads) may rebuild the same cache at once
+inline std::string temp_path(const std::string &path) {
+    static std::atomic<unsigned> counter(0);
+#ifdef _WIN32
+    const unsigned long pid = GetCurrentProcessId();
+#else
+    const unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+    return path + ".tmp." + std::to_string(pid) + "." +
+           std::to_string(counter.fetch_add(1));
+}
+
+// Contents the size checks cannot catch but traversal relies on: indices
+// name existing vertices, flags only ask for arrays the file has, leaves
+// cover existing triangles, and every interior node's second child comes
+// after its first (i + 1) and within the array. Children always after
+// their parent also rule out cycles, and the depth bound keeps
+// linear_bvh::traverse within its stack. One pass, far cheaper than
+// parsing the OBJ.
+inline bool valid_mesh_arrays(const triangle_mesh_view &view) {
+    const uint64_t vertices = view.vertex_count;
+    const uint64_t triangles = view.triangle_count;
+    const uint64_t nodes = view.node_count;
+    for (uint64_t i = 0; i < 3 * triangles; i++) {
+        if (view.indices[i] >= vertices) {
+            return false;
+        }
+    }
+    const uint8_t allowed =
+        static_cast<uint8_t>((view.nx ? kMeshTriangleNormals : 0) |
+                             (view.u ? kMeshTriangleUVs : 0));
+    for (uint64_t i = 0; i < triangles; i++) {
+        if (view.flags[i] & ~allowed) {
+            return false;
+        }
+    }
+    std::vector<uint8_t> depth(nodes, 0);
+    for (uint64_t i = 0; i < nodes; i++) {
+        const linear_bvh_node &node = view.nodes[i];
+        if (node.is_leaf()) {
+            if (node.offset > triangles ||
+                node.primitive_count > triangles - node.offset) {
+                return false;
+            }
+            continue;
+        }
+        if (node.offset <= i + 1 || node.offset >= nodes ||
+            depth[i] >= kBvhMaxDepth) {
+            return false;
+        }
+        const uint8_t child = static_cast<uint8_t>(depth[i] + 1);
+        depth[i + 1] = std::max(depth[i + 1], child);
+        depth[node.offset] = std::max(depth[node.offset], child);
+    }
+    return true;
+}
+
+// Moves temp over path in one step, so readers see the old cache or the
+// new one and never no cache at all
+inline bool replace_file(const std::string &temp, const std::string &path) {
+#ifdef _WIN32
+    return MoveFileExA(temp.c_str(), path.c_str(),
+                       MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(temp.c_str(), path.c_str()) == 0;
+#endif
+}
+
+} // namespace mesh_cache_detail
+
+// Writes mesh to path through a temporary file that is renamed into place,
+// so a concurrent reader never sees a half-written cache
+inline bool write_mesh_cache(const std::string &path,
+                             const mesh_cache_key &key,
+                             const triangle_mesh &mesh) {
+    using namespace mesh_cache_detail;
+    const triangle_mesh_view &view = mesh.view();
+
+    const void *data[kSectionCount] = {
+        view.x,  view.y,  view.z,       view.nx,    view.ny,   view.nz,
+        view.u,  view.v,  view.indices, view.flags, view.nodes};
+    const uint64_t vertices = view.vertex_count;
+    const uint64_t triangles = view.triangle_count;
+    const uint64_t bytes[kSectionCount] = {
+        vertices * 4,
+        vertices * 4,
+        vertices * 4,
+        view.nx ? vertices * 4 : 0,
+        view.ny ? vertices * 4 : 0,
+        view.nz ? vertices * 4 : 0,
+        view.u ? vertices * 4 : 0,
+        view.v ? vertices * 4 : 0,
+        triangles * 3 * sizeof(uint32_t),
+        triangles,
+        view.node_count * sizeof(linear_bvh_node)};
+
+    header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, kMeshCacheMagic, sizeof(h.magic));
+    h.version = kMeshCacheVersion;
+    h.byte_order = kMeshCacheByteOrder;
+    h.node_size = sizeof(linear_bvh_node);
+    h.has_normals = view.nx ? 1 : 0;
+    h.has_uvs = view.u ? 1 : 0;
+    h.vertex_count = vertices;
+    h.triangle_count = triangles;
+    h.node_count = view.node_count;
+    for (int a = 0; a < 3; a++) {
+        h.box_min[a] = view.box.min()[a];
+        h.box_max[a] = view.box.max()[a];
+    }
+    h.sah_cost = view.sah_cost;
+    h.key = key;
+    uint64_t offset = align_up(sizeof(header));
+    for (int s = 0; s < kSectionCount; s++) {
+        h.size[s] = data[s] ? bytes[s] : 0;
+        h.offset[s] = h.size[s] ? offset : 0;
+        offset = align_up(offset + h.size[s]);
+    }
+    h.file_size = offset;
+
+    const std::string temp = temp_path(path);
+    FILE *file = std::fopen(temp.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    static const char zeros[kMeshCacheAlignment] = {};
+    bool ok = std::fwrite(&h, sizeof(h), 1, file) == 1;
+    uint64_t written = sizeof(h);
+    for (int s = 0; s < kSectionCount && ok; s++) {
+        if (h.size[s] == 0) {
+            continue;
+        }
+        ok = std::fwrite(zeros, 1, h.offset[s] - written, file) ==
+                 h.offset[s] - written &&
+             std::fwrite(data[s], 1, h.size[s], file) == h.size[s];
+        written = h.offset[s] + h.size[s];
+    }
+    ok = ok && std::fwrite(zeros, 1, h.file_size - written, file) ==
+                   h.file_size - written;
+    ok = std::fclose(file) == 0 && ok;
+    ok = ok && replace_file(temp, path);
+    if (!ok) {
+        std::remove(temp.c_str());
+    }
+    return ok;
+}
+
+// Maps the cache at path and returns a mesh using it in place, or nullptr
+// if there is none, it does not match key or its arrays are inconsistent
+inline shared_ptr<triangle_mesh> read_mesh_cache(const std::string &path,
+                                                 const mesh_cache_key &key,
+                                                 shared_ptr<material> mat) {
+    using namespace mesh_cache_detail;
+    auto file = std::make_shared<mapped_file>();
+    // BVH traversal touches the arrays in no particular order
+    if (!file->open(path, false) || file->size() < sizeof(header)) {
+        return nullptr;
+    }
+    header h;
+    std::memcpy(&h, file->data(), sizeof(h));
+    if (std::memcmp(h.magic, kMeshCacheMagic, sizeof(h.magic)) != 0 ||
+        h.version != kMeshCacheVersion ||
+        h.byte_order != kMeshCacheByteOrder ||
+        h.node_size != sizeof(linear_bvh_node) ||
+        h.file_size != file->size() ||
+        std::memcmp(&h.key, &key, sizeof(key)) != 0) {
+        return nullptr;
+    }
+
+    const uint64_t vertices = h.vertex_count;
+    const uint64_t triangles = h.triangle_count;
+    const uint64_t expected[kSectionCount] = {
+        vertices * 4,
+        vertices * 4,
+        vertices * 4,
+        h.has_normals ? vertices * 4 : 0,
+        h.has_normals ? vertices * 4 : 0,
+        h.has_normals ? vertices * 4 : 0,
+        h.has_uvs ? vertices * 4 : 0,
+        h.has_uvs ? vertices * 4 : 0,
+        triangles * 3 * sizeof(uint32_t),
+        triangles,
+        h.node_count * sizeof(linear_bvh_node)};
+    const void *section[kSectionCount] = {};
+    for (int s = 0; s < kSectionCount; s++) {
+        if (h.size[s] != expected[s] ||
+            h.offset[s] % kMeshCacheAlignment != 0 ||
+            h.offset[s] > h.file_size ||
+            h.size[s] > h.file_size - h.offset[s]) {
+            return nullptr;
+        }
+        if (h.size[s] > 0) {
+            section[s] = file->data() + h.offset[s];
+        }
+    }
+
+    triangle_mesh_view view;
+    view.x = static_cast<const float *>(section[kX]);
+    view.y = static_cast<const float *>(section[kY]);
+    view.z = static_cast<const float *>(section[kZ]);
+    view.nx = static_cast<const float *>(section[kNormalX]);
+    view.ny = static_cast<const float *>(section[kNormalY]);
+    view.nz = static_cast<const float *>(section[kNormalZ]);
+    view.u = static_cast<const float *>(section[kU]);
+    view.v = static_cast<const float *>(section[kV]);
+    view.indices = static_cast<const uint32_t *>(section[kIndices]);
+    view.flags = static_cast<const uint8_t *>(section[kFlags]);
+    view.nodes = static_cast<const linear_bvh_node *>(section[kNodes]);
+    view.vertex_count = static_cast<size_t>(vertices);
+    view.triangle_count = static_cast<size_t>(triangles);
+    view.node_count = static_cast<size_t>(h.node_count);
+    view.scale = vec3(key.scale[0], key.scale[1], key.scale[2]);
+    view.translation =
+        vec3(key.translation[0], key.translation[1], key.translation[2]);
+    view.box = aabb(point3(h.box_min[0], h.box_min[1], h.box_min[2]),
+                    point3(h.box_max[0], h.box_max[1], h.box_max[2]));
+    view.sah_cost = h.sah_cost;
+    if (!valid_mesh_arrays(view)) {
+        return nullptr;
+    }
+    return make_shared<triangle_mesh>(view, file, std::move(mat));
+}
+
+#endif
@@ -0,0 +1,381 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Corner of an OBJ face: its position, normal and texture coordinate index,
+// 0-based (-1 when missing or invalid)
+struct obj_corner {
+    int vertex;
+    int normal;
+    int texcoord;
+
+    bool operator==(const obj_corner &other) const {
+        return vertex == other.vertex && normal == other.normal &&
+               texcoord == other.texcoord;
+    }
+};
+
+struct obj_corner_hash {
+    size_t operator()(const obj_corner &c) const {
+        uint64_t h = static_cast<uint32_t>(c.vertex);
+        h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(c.normal);
+        h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(c.texcoord);
+        return static_cast<size_t>(h ^ (h >> 29));
+    }
+};
+
+// Geometry of an OBJ file. Faces with more than three corners are split
+// into a triangle fan; groups, smoothing groups and materials are ignored.
+struct obj_data {
+    std::vector<float> positions;    // x, y, z per 'v'
+    std::vector<float> normals;      // x, y, z per 'vn'
+    std::vector<float> texcoords;    // u, v per 'vt'
+    std::vector<obj_corner> corners; // three per triangle
+    size_t skipped_faces = 0;        // faces with fewer than three corners
+};
+
+struct obj_parse_options {
+    int num_threads = 0; // 0: one per hardware thread for large files
+};
+
+// Files below this size are always parsed on the calling thread
+constexpr size_t kObjParallelMinBytes = 1 << 20;
+
+namespace obj_detail {
+
+inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char *skip_blanks(const char *p, const char *end) {
+    while (p < end && is_blank(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+inline const char *next_line(const char *p, const char *end) {
+    const void *newline = std::memchr(p, '\n', static_cast<size_t>(end - p));
+    return newline ? static_cast<const char *>(newline) + 1 : end;
+}
+
+// Exact powers of ten: below 1e23 every one is a double
+constexpr double kPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                             1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                             1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Parses a decimal number ([sign] digits [. digits] [e [sign] digits]) at p
+// and returns the position after it, or p if there is none. Results are
+// correctly rounded like strtod: numbers with at most 15 significant digits
+// and a small exponent (all that OBJ exporters write) are computed exactly
+// from integer parts, the rest are handed to strtod.
+inline const char *parse_double(const char *p, const char *end, double &out) {
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0; // significant digits in mantissa
+    int exponent = 0;
+    bool any_digit = false;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        any_digit = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            digits += mantissa != 0;
+        } else {
+            ++exponent;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+            any_digit = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+    if (!any_digit) {
+        return start;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *e = p + 1;
+        bool negative_exponent = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            negative_exponent = *e == '-';
+            ++e;
+        }
+        if (e < end && *e >= '0' && *e <= '9') {
+            int value = 0;
+            for (; e < end && *e >= '0' && *e <= '9'; ++e) {
+                value = std::min(value * 10 + (*e - '0'), 100000);
+            }
+            exponent += negative_exponent ? -value : value;
+            p = e;
+        }
+    }
+
+    if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / kPow10[-exponent]
+                             : value * kPow10[exponent];
+        out = negative ? -value : value;
+        return p;
+    }
+
+    // Rare: long mantissa or large exponent
+    char buffer[128];
+    size_t length = std::min(static_cast<size_t>(p - start),
+                             sizeof(buffer) - 1);
+    std::memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    out = std::strtod(buffer, nullptr);
+    return p;
+}
+
+inline const char *parse_int(const char *p, const char *end, long &out) {
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    long value = 0;
+    const char *digits = p;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        value = std::min(value * 10 + (*p - '0'), 1L << 40);
+    }
+    if (p == digits) {
+        return start;
+    }
+    out = negative ? -value : value;
+    return p;
+}
+
+// Per-thread result of parsing a run of whole lines
+struct chunk {
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    std::vector<obj_corner> corners;
+    // Corner fields (3 * corner + 0/1/2 for vertex/normal/texcoord) that
+    // hold a relative index resolved against this chunk's own counts; the
+    // merge adds the counts of the chunks before it
+    std::vector<size_t> relative;
+    size_t skipped_faces = 0;
+
+    // Reused by every face line
+    std::vector<obj_corner> face;
+    std::vector<uint8_t> face_relative;
+};
+
+// OBJ indices are 1-based, or relative to the current count when negative.
+// Sets bit `field` of relative_mask for the latter.
+inline int resolve_index(long index, size_t count, int field,
+                         uint8_t &relative_mask) {
+    if (index > 0) {
+        return index <= INT32_MAX ? static_cast<int>(index - 1) : -1;
+    }
+    if (index < 0) {
+        relative_mask |= static_cast<uint8_t>(1 << field);
+        return static_cast<int>(static_cast<long>(count) + index);
+    }
+    return -1;
+}
+
+inline const char *parse_floats(const char *p, const char *end, int count,
+                                std::vector<float> &out) {
+    for (int i = 0; i < count; ++i) {
+        double value = 0.0;
+        p = skip_blanks(p, end);
+        p = parse_double(p, end, value);
+        out.push_back(static_cast<float>(value));
+    }
+    return p;
+}
+
+inline void emit_corner(chunk &out, size_t index) {
+    const size_t corner = out.corners.size();
+    out.corners.push_back(out.face[index]);
+    for (int field = 0; field < 3; ++field) {
+        if (out.face_relative[index] & (1 << field)) {
+            out.relative.push_back(3 * corner + field);
+        }
+    }
+}
+
+// Corners of one 'f' line ("v", "v/t", "v//n" or "v/t/n" each)
+inline void parse_face(const char *p, const char *end, chunk &out) {
+    out.face.clear();
+    out.face_relative.clear();
+    const size_t vertex_count = out.positions.size() / 3;
+    const size_t normal_count = out.normals.size() / 3;
+    const size_t texcoord_count = out.texcoords.size() / 2;
+
+    while (true) {
+        p = skip_blanks(p, end);
+        long v = 0, t = 0, n = 0;
+        const char *after = parse_int(p, end, v);
+        if (after == p) {
+            break;
+        }
+        p = after;
+        if (p < end && *p == '/') {
+            p = parse_int(p + 1, end, t);
+            if (p < end && *p == '/') {
+                p = parse_int(p + 1, end, n);
+            }
+        }
+
+        uint8_t relative_mask = 0;
+        obj_corner corner;
+        corner.vertex = resolve_index(v, vertex_count, 0, relative_mask);
+        corner.normal = resolve_index(n, normal_count, 1, relative_mask);
+        corner.texcoord = resolve_index(t, texcoord_count, 2, relative_mask);
+        out.face.push_back(corner);
+        out.face_relative.push_back(relative_mask);
+    }
+
+    if (out.face.size() < 3) {
+        out.skipped_faces++;
+        return;
+    }
+    for (size_t k = 1; k + 1 < out.face.size(); ++k) {
+        emit_corner(out, 0);
+        emit_corner(out, k);
+        emit_corner(out, k + 1);
+    }
+}
+
+inline void parse_lines(const char *p, const char *end, chunk &out) {
+    while (p < end) {
+        const char *line_end = next_line(p, end);
+        p = skip_blanks(p, line_end);
+        if (p + 1 < line_end) {
+            if (p[0] == 'v' && is_blank(p[1])) {
+                parse_floats(p + 2, line_end, 3, out.positions);
+            } else if (p[0] == 'v' && p[1] == 'n' && p + 2 < line_end &&
+                       is_blank(p[2])) {
+                parse_floats(p + 3, line_end, 3, out.normals);
+            } else if (p[0] == 'v' && p[1] == 't' && p + 2 < line_end &&
+                       is_blank(p[2])) {
+                parse_floats(p + 3, line_end, 2, out.texcoords);
+            } else if (p[0] == 'f' && is_blank(p[1])) {
+                parse_face(p + 2, line_end, out);
+            }
+            // Anything else (comments, o/g/s, usemtl, ...) is skipped
+        }
+        p = line_end;
+    }
+}
+
+// Moves every chunk into out, rebasing relative indices
+inline void merge_chunks(std::vector<chunk> &chunks, obj_data &out) {
+    size_t positions = 0, normals = 0, texcoords = 0, corners = 0;
+    for (const auto &c : chunks) {
+        positions += c.positions.size();
+        normals += c.normals.size();
+        texcoords += c.texcoords.size();
+        corners += c.corners.size();
+    }
+    out.positions.reserve(positions);
+    out.normals.reserve(normals);
+    out.texcoords.reserve(texcoords);
+    out.corners.reserve(corners);
+
+    for (auto &c : chunks) {
+        const int base[3] = {static_cast<int>(out.positions.size() / 3),
+                             static_cast<int>(out.normals.size() / 3),
+                             static_cast<int>(out.texcoords.size() / 2)};
+        for (size_t field : c.relative) {
+            obj_corner &corner = c.corners[field / 3];
+            int &index = field % 3 == 0   ? corner.vertex
+                         : field % 3 == 1 ? corner.normal
+                                          : corner.texcoord;
+            index += base[field % 3];
+        }
+        out.positions.insert(out.positions.end(), c.positions.begin(),
+                             c.positions.end());
+        out.normals.insert(out.normals.end(), c.normals.begin(),
+                           c.normals.end());
+        out.texcoords.insert(out.texcoords.end(), c.texcoords.begin(),
+                             c.texcoords.end());
+        out.corners.insert(out.corners.end(), c.corners.begin(),
+                           c.corners.end());
+        out.skipped_faces += c.skipped_faces;
+        c = chunk(); // free as we go
+    }
+}
+
+} // namespace obj_detail
+
+// Parses an OBJ file through a memory mapping, with large files split at
+// line boundaries into one chunk per thread. Returns false with a message
+// in error if the file cannot be read.
+inline bool parse_obj(const std::string &filename, obj_data &out,
+                      std::string &error,
+                      const obj_parse_options &options = obj_parse_options()) {
+    out = obj_data();
+    mapped_file file;
+    if (!file.open(filename)) {
+        error = "Cannot open file: " + filename;
+        return false;
+    }
+    const char *begin = file.data();
+    const char *end = begin + file.size();
+
+    int threads = 1;
+    if (options.num_threads > 0) {
+        threads = options.num_threads;
+    } else if (file.size() >= kObjParallelMinBytes) {
+        threads = static_cast<int>(
+            std::max(1u, std::thread::hardware_concurrency()));
+    }
+    threads = static_cast<int>(std::max<size_t>(
+        1, std::min<size_t>(threads, file.size() / 4096 + 1)));
+
+    // Chunk c covers the lines that start in [cuts[c], cuts[c + 1])
+    std::vector<const char *> cuts(threads + 1, end);
+    cuts[0] = begin;
+    for (int c = 1; c < threads; ++c) {
+        const char *guess = begin + file.size() * c / threads;
+        cuts[c] = std::max(cuts[c - 1], obj_detail::next_line(guess, end));
+    }
+
+    std::vector<obj_detail::chunk> chunks(threads);
+    {
+        const size_t reserve = file.size() / threads / 32;
+        auto parse = [&](int c) {
+            chunks[c].positions.reserve(reserve);
+            chunks[c].corners.reserve(reserve / 2);
+            obj_detail::parse_lines(cuts[c], cuts[c + 1], chunks[c]);
+        };
+        std::vector<std::thread> workers;
+        for (int c = 1; c < threads; ++c) {
+            workers.emplace_back(parse, c);
+        }
+        parse(0);
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+    obj_detail::merge_chunks(chunks, out);
+    return true;
+}
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef PRIMITIVE_STORE_H
+#define PRIMITIVE_STORE_H
+
+#include <cstdint>
+#include <typeinfo>
+#include <vector>
+
+#include "aarect.h"
+#include "hittable.h"
+#include "moving_sphere.h"
+#include "ray.h"
+#include "rtweekend.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "vec3.h"
+
+// Tag of a primitive_store slot: which array its geometry is in
+enum class primitive_kind : uint8_t {
+    kHittable, // any other hittable, called through its virtuals
+    kSphere,
+    kMovingSphere,
+    kXYRect,
+    kXZRect,
+    kYZRect,
+    kTriangle,
+};
+
+// The primitives of a BVH in leaf order. The geometry of spheres, moving
+// spheres, rects and triangles is copied into one contiguous array per kind
+// when the tree is built, and a leaf loop switches on each slot's tag to
+// run the intersection inline instead of calling a virtual. A hit still
+// names the original object, whose surface() finishes it, so scenes are
+// built from the hittable classes as before.
+class primitive_store {
+  public:
+    primitive_store() = default;
+    explicit primitive_store(std::vector<shared_ptr<hittable>> objects);
+
+    size_t size() const {
+        return m_objects.size();
+    }
+
+    // hittable::intersect and hittable::occluded of primitive i
+    bool intersect(uint32_t i, const ray &r, double t_min, double t_max,
+                   hit_record &rec) const;
+    bool occluded(uint32_t i, const ray &r, double t_min,
+                  double t_max) const;
+
+  private:
+    struct slot {
+        primitive_kind kind;
+        uint32_t index; // into the array of its kind
+    };
+    struct sphere_data {
+        point3 center;
+        double radius;
+    };
+    struct moving_sphere_data {
+        point3 center0, center1;
+        double time0, time1;
+        double radius;
+    };
+    struct rect_data {
+        double a0, a1, b0, b1, k; // both in-plane ranges and the plane
+    };
+    struct triangle_data {
+        point3 v0;
+        vec3 edge1, edge2;
+    };
+
+    // Distance t and the coordinates the primitive's intersect() would
+    // leave in u and v, for a slot that is not kHittable
+    bool test(slot s, const ray &r, double t_min, double t_max, double &t,
+              double &u, double &v) const;
+
+    std::vector<shared_ptr<hittable>> m_objects;
+    std::vector<slot> m_slots;
+    std::vector<sphere_data> m_spheres;
+    std::vector<moving_sphere_data> m_moving_spheres;
+    std::vector<rect_data> m_rects; // all three orientations
+    std::vector<triangle_data> m_triangles;
+};
+
+inline primitive_store::primitive_store(
+    std::vector<shared_ptr<hittable>> objects)
+    : m_objects(std::move(objects)) {
+    m_slots.reserve(m_objects.size());
+    for (const auto &object : m_objects) {
+        // Exact types only: a subclass may have changed what a hit is
+        const std::type_info &type = typeid(*object);
+        slot s{primitive_kind::kHittable, 0};
+        if (type == typeid(sphere)) {
+            const auto &p = static_cast<const sphere &>(*object);
+            s = {primitive_kind::kSphere,
+                 static_cast<uint32_t>(m_spheres.size())};
+            m_spheres.push_back({p.center, p.radius});
+        } else if (type == typeid(moving_sphere)) {
+            const auto &p = static_cast<const moving_sphere &>(*object);
+            s = {primitive_kind::kMovingSphere,
+                 static_cast<uint32_t>(m_moving_spheres.size())};
+            m_moving_spheres.push_back(
+                {p.center0, p.center1, p.time0, p.time1, p.radius});
+        } else if (type == typeid(xy_rect)) {
+            const auto &p = static_cast<const xy_rect &>(*object);
+            s = {primitive_kind::kXYRect,
+                 static_cast<uint32_t>(m_rects.size())};
+            m_rects.push_back({p.x0, p.x1, p.y0, p.y1, p.k});
+        } else if (type == typeid(xz_rect)) {
+            const auto &p = static_cast<const xz_rect &>(*object);
+            s = {primitive_kind::kXZRect,
+                 static_cast<uint32_t>(m_rects.size())};
+            m_rects.push_back({p.x0, p.x1, p.z0, p.z1, p.k});
+        } else if (type == typeid(yz_rect)) {
+            const auto &p = static_cast<const yz_rect &>(*object);
+            s = {primitive_kind::kYZRect,
+                 static_cast<uint32_t>(m_rects.size())};
+            m_rects.push_back({p.y0, p.y1, p.z0, p.z1, p.k});
+        } else if (type == typeid(triangle)) {
+            const auto &p = static_cast<const triangle &>(*object);
+            s = {primitive_kind::kTriangle,
+                 static_cast<uint32_t>(m_triangles.size())};
+            m_triangles.push_back({p.v0, p.edge1, p.edge2});
+        }
+        m_slots.push_back(s);
+    }
+}
+
+inline bool primitive_store::test(slot s, const ray &r, double t_min,
+                                  double t_max, double &t, double &u,
+                                  double &v) const {
+    switch (s.kind) {
+    case primitive_kind::kSphere: {
+        const sphere_data &d = m_spheres[s.index];
+        return sphere_nearest_root(d.center, d.radius, r, t_min, t_max, t);
+    }
+    case primitive_kind::kMovingSphere: {
+        const moving_sphere_data &d = m_moving_spheres[s.index];
+        const point3 center =
+            moving_center(d.center0, d.center1, d.time0, d.time1, r.time());
+        return sphere_nearest_root(center, d.radius, r, t_min, t_max, t);
+    }
+    case primitive_kind::kXYRect: {
+        const rect_data &d = m_rects[s.index];
+        return axis_rect_hit<2, 0, 1>(r, d.a0, d.a1, d.b0, d.b1, d.k, t_min,
+                                      t_max, t, u, v);
+    }
+    case primitive_kind::kXZRect: {
+        const rect_data &d = m_rects[s.index];
+        return axis_rect_hit<1, 0, 2>(r, d.a0, d.a1, d.b0, d.b1, d.k, t_min,
+                                      t_max, t, u, v);
+    }
+    case primitive_kind::kYZRect: {
+        const rect_data &d = m_rects[s.index];
+        return axis_rect_hit<0, 1, 2>(r, d.a0, d.a1, d.b0, d.b1, d.k, t_min,
+                                      t_max, t, u, v);
+    }
+    case primitive_kind::kTriangle: {
+        const triangle_data &d = m_triangles[s.index];
+        return moller_trumbore(d.v0, d.edge1, d.edge2, r, t_min, t_max, t, u,
+                               v);
+    }
+    case primitive_kind::kHittable:
+    default:
+        return false;
+    }
+}
+
+inline bool primitive_store::intersect(uint32_t i, const ray &r,
+                                       double t_min, double t_max,
+                                       hit_record &rec) const {
+    const slot s = m_slots[i];
+    if (s.kind == primitive_kind::kHittable) {
+        return m_objects[i]->intersect(r, t_min, t_max, rec);
+    }
+    double t, u = 0.0, v = 0.0;
+    if (!test(s, r, t_min, t_max, t, u, v)) {
+        return false;
+    }
+    rec.t = t;
+    rec.u = u;
+    rec.v = v;
+    rec.object = m_objects[i].get();
+    rec.transform_count = 0;
+    return true;
+}
+
+inline bool primitive_store::occluded(uint32_t i, const ray &r, double t_min,
+                                      double t_max) const {
+    const slot s = m_slots[i];
+    if (s.kind == primitive_kind::kHittable) {
+        return m_objects[i]->occluded(r, t_min, t_max);
+    }
+    double t, u, v;
+    return test(s, r, t_min, t_max, t, u, v);
+}
+
+#endif
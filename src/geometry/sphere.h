@@ -4,6 +4,30 @@
 #include "hittable.h"
 #include "vec3.h"
 
+// Nearest root of the ray-sphere quadratic in [t_min, t_max]. Shared by
+// sphere, moving_sphere and primitive_store.
+inline bool sphere_nearest_root(const point3 &center, double radius,
+                                const ray &r, double t_min, double t_max,
+                                double &root) {
+    vec3 oc = r.origin() - center;
+    auto a = r.direction().length_squared();
+    auto half_b = dot(oc, r.direction());
+    auto c = oc.length_squared() - radius * radius;
+
+    auto discriminant = half_b * half_b - a * c;
+    if (discriminant < 0)
+        return false;
+    auto sqrtd = sqrt(discriminant);
+
+    root = (-half_b - sqrtd) / a;
+    if (root < t_min || root > t_max) {
+        root = (-half_b + sqrtd) / a;
+        if (root < t_min || root > t_max)
+            return false;
+    }
+    return true;
+}
+
 class sphere : public hittable {
   public:
     sphere(point3 cen, double r, shared_ptr<material> m)
@@ -15,6 +39,17 @@ class sphere : public hittable {
     virtual bool bounding_box(double time0, double time1,
                               aabb &output_box) const override;
 
+    virtual bool occluded(const ray &r, double t_min,
+                          double t_max) const override {
+        double root;
+        return sphere_nearest_root(center, radius, r, t_min, t_max, root);
+    }
+
+    virtual bool intersect(const ray &r, double t_min, double t_max,
+                           hit_record &rec) const override;
+
+    virtual void surface(const ray &r, hit_record &rec) const override;
+
   public:
     point3 center;
     double radius;
@@ -30,36 +65,36 @@ class sphere : public hittable {
     }
 };
 
-bool sphere::hit(const ray &r, double t_min, double t_max,
-                 hit_record &rec) const {
-    vec3 oc = r.origin() - center;
-    auto a = r.direction().length_squared();
-    auto half_b = dot(oc, r.direction());
-    auto c = oc.length_squared() - radius * radius;
-
-    auto discriminant = half_b * half_b - a * c;
-    if (discriminant < 0)
+inline bool sphere::intersect(const ray &r, double t_min, double t_max,
+                              hit_record &rec) const {
+    double root;
+    if (!sphere_nearest_root(center, radius, r, t_min, t_max, root))
         return false;
-    auto sqrtd = sqrt(discriminant);
-
-    auto root = (-half_b - sqrtd) / a;
-    if (root < t_min || root > t_max) {
-        root = (-half_b + sqrtd) / a;
-        if (root < t_min || root > t_max)
-            return false;
-    }
 
     rec.t = root;
+    rec.object = this;
+    rec.transform_count = 0;
+    return true;
+}
+
+inline void sphere::surface(const ray &r, hit_record &rec) const {
     rec.p = r.at(rec.t);
     vec3 outward_normal = (rec.p - center) / radius;
     rec.set_face_normal(r, outward_normal);
     get_sphere_uv(outward_normal, rec.u, rec.v);
     rec.mat_ptr = mat_ptr.get();
+}
 
+inline bool sphere::hit(const ray &r, double t_min, double t_max,
+                        hit_record &rec) const {
+    if (!intersect(r, t_min, t_max, rec))
+        return false;
+    surface(r, rec);
     return true;
 }
 
-bool sphere::bounding_box(double time0, double time1, aabb &output_box) const {
+inline bool sphere::bounding_box(double time0, double time1,
+                                aabb &output_box) const {
     output_box = aabb(center - vec3(radius, radius, radius),
                       center + vec3(radius, radius, radius));
     return true;
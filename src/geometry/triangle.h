@@ -7,6 +7,37 @@
 #include "material.h"
 #include "vec3.h"
 
+// Möller-Trumbore: distance and barycentrics of the hit. Shared by
+// triangle, triangle_mesh and primitive_store.
+inline bool moller_trumbore(const point3 &v0, const vec3 &edge1,
+                            const vec3 &edge2, const ray &r, double t_min,
+                            double t_max, double &t, double &bary_u,
+                            double &bary_v) {
+    const double eps = 1e-8;
+    vec3 pvec = cross(r.direction(), edge2);
+    double det = dot(edge1, pvec);
+
+    if (fabs(det) < eps) {
+        return false;
+    }
+
+    double inv_det = 1.0 / det;
+    vec3 tvec = r.origin() - v0;
+    bary_u = dot(tvec, pvec) * inv_det;
+    if (bary_u < 0.0 || bary_u > 1.0) {
+        return false;
+    }
+
+    vec3 qvec = cross(tvec, edge1);
+    bary_v = dot(r.direction(), qvec) * inv_det;
+    if (bary_v < 0.0 || bary_u + bary_v > 1.0) {
+        return false;
+    }
+
+    t = dot(edge2, qvec) * inv_det;
+    return !(t < t_min || t > t_max);
+}
+
 class triangle : public hittable {
   public:
     triangle(const point3 &p0, const point3 &p1, const point3 &p2,
@@ -50,47 +81,39 @@ class triangle : public hittable {
 
     bool hit(const ray &r, double t_min, double t_max,
              hit_record &rec) const override {
-        const double eps = 1e-8;
-        vec3 pvec = cross(r.direction(), edge2);
-        double det = dot(edge1, pvec);
-
-        if (fabs(det) < eps) {
-            return false;
-        }
-
-        double inv_det = 1.0 / det;
-        vec3 tvec = r.origin() - v0;
-        double bary_u = dot(tvec, pvec) * inv_det;
-        if (bary_u < 0.0 || bary_u > 1.0) {
-            return false;
-        }
-
-        vec3 qvec = cross(tvec, edge1);
-        double bary_v = dot(r.direction(), qvec) * inv_det;
-        if (bary_v < 0.0 || bary_u + bary_v > 1.0) {
+        if (!intersect(r, t_min, t_max, rec)) {
             return false;
         }
+        surface(r, rec);
+        return true;
+    }
 
-        double t = dot(edge2, qvec) * inv_det;
-        if (t < t_min || t > t_max) {
+    // Barycentrics in rec.u, rec.v until surface()
+    bool intersect(const ray &r, double t_min, double t_max,
+                   hit_record &rec) const override {
+        double t, bary_u, bary_v;
+        if (!moller_trumbore(v0, edge1, edge2, r, t_min, t_max, t, bary_u,
+                             bary_v)) {
             return false;
         }
-
         rec.t = t;
-        rec.p = r.at(t);
+        rec.u = bary_u;
+        rec.v = bary_v;
+        rec.object = this;
+        rec.transform_count = 0;
+        return true;
+    }
+
+    void surface(const ray &r, hit_record &rec) const override {
+        const double bary_u = rec.u;
+        const double bary_v = rec.v;
+        rec.p = r.at(rec.t);
         rec.mat_ptr = mat_ptr.get();
 
         double w = 1.0 - bary_u - bary_v;
         if (has_texcoords) {
-            double interpolated_u =
-                w * uv0.x() + bary_u * uv1.x() + bary_v * uv2.x();
-            double interpolated_v =
-                w * uv0.y() + bary_u * uv1.y() + bary_v * uv2.y();
-            rec.u = interpolated_u;
-            rec.v = interpolated_v;
-        } else {
-            rec.u = bary_u;
-            rec.v = bary_v;
+            rec.u = w * uv0.x() + bary_u * uv1.x() + bary_v * uv2.x();
+            rec.v = w * uv0.y() + bary_u * uv1.y() + bary_v * uv2.y();
         }
 
         vec3 shading_normal = face_normal;
@@ -103,8 +126,12 @@ class triangle : public hittable {
 
         // 2) shading_normal 仍然用插值法线（你原来的逻辑是对的），但朝向要跟 front_face 一致
         rec.normal = rec.front_face ? shading_normal : -shading_normal;
+    }
 
-        return true;
+    bool occluded(const ray &r, double t_min, double t_max) const override {
+        double t, bary_u, bary_v;
+        return moller_trumbore(v0, edge1, edge2, r, t_min, t_max, t, bary_u,
+                               bary_v);
     }
 
     bool bounding_box(double /*time0*/, double /*time1*/,
@@ -125,6 +152,8 @@ class triangle : public hittable {
     }
 
   private:
+    friend class primitive_store;
+
     point3 v0;
     point3 v1;
     point3 v2;
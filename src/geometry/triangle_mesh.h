@@ -0,0 +1,406 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "aabb.h"
+#include "aligned_array.h"
+#include "bvh_build.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+#include "material.h"
+#include "ray.h"
+#include "rtweekend.h"
+#include "triangle.h"
+#include "vec3.h"
+
+// Per-triangle flags of triangle_mesh_buffers::flags
+constexpr uint8_t kMeshTriangleNormals = 1; // interpolate vertex normals
+constexpr uint8_t kMeshTriangleUVs = 2;     // interpolate texture coordinates
+
+// Raw input of a triangle_mesh. Vertex attributes are stored one array per
+// component and shared by all triangles that use the vertex.
+struct triangle_mesh_buffers {
+    std::vector<float> x, y, z;    // positions before scale/translation
+    std::vector<float> nx, ny, nz; // normals (need not be unit); optional
+    std::vector<float> u, v;       // texture coordinates; optional
+    std::vector<uint32_t> indices; // three vertex indices per triangle
+    std::vector<uint8_t> flags;    // per triangle; empty: from the arrays
+
+    // Applied to every position, in double, as p * scale + translation
+    vec3 scale{1, 1, 1};
+    vec3 translation{0, 0, 0};
+
+    size_t vertex_count() const {
+        return x.size();
+    }
+    size_t triangle_count() const {
+        return indices.size() / 3;
+    }
+};
+
+// Read-only view of the arrays a triangle_mesh works on. They live either
+// in the mesh's own buffers or in a mapped cache file (mesh_cache.h).
+struct triangle_mesh_view {
+    const float *x = nullptr, *y = nullptr, *z = nullptr;
+    const float *nx = nullptr, *ny = nullptr, *nz = nullptr; // may be null
+    const float *u = nullptr, *v = nullptr;                  // may be null
+    const uint32_t *indices = nullptr; // in BVH leaf order
+    const uint8_t *flags = nullptr;
+    const linear_bvh_node *nodes = nullptr; // null without a BVH
+    size_t vertex_count = 0;
+    size_t triangle_count = 0;
+    size_t node_count = 0;
+
+    vec3 scale{1, 1, 1};
+    vec3 translation{0, 0, 0};
+    aabb box;
+    double sah_cost = 0.0;
+};
+
+// Triangle mesh with one material, shared vertex arrays and a uint32 index
+// buffer: about 50 bytes per triangle including its BVH, where a
+// shared_ptr<triangle> per face takes over 300. The BVH (linear_bvh layout)
+// is built over triangle indices and the index buffer is reordered so that
+// each leaf covers a contiguous range of triangles, which are intersected
+// directly instead of through hittable::hit.
+class triangle_mesh : public hittable {
+  public:
+    triangle_mesh(triangle_mesh_buffers buffers, shared_ptr<material> mat,
+                  bool build_bvh = true,
+                  const bvh_build_options &options =
+                      default_bvh_build_options());
+
+    // Uses arrays that already hold a finished mesh (indices in leaf order,
+    // nodes built) without copying them; storage keeps them alive
+    triangle_mesh(const triangle_mesh_view &arrays,
+                  shared_ptr<const void> storage, shared_ptr<material> mat)
+        : mat_ptr(std::move(mat)),
+          m_storage(std::move(storage)),
+          m_view(arrays) {
+    }
+
+    // view() points into this object
+    triangle_mesh(const triangle_mesh &) = delete;
+    triangle_mesh &operator=(const triangle_mesh &) = delete;
+
+    bool hit(const ray &r, double t_min, double t_max,
+             hit_record &rec) const override;
+
+    bool occluded(const ray &r, double t_min, double t_max) const override;
+
+    bool intersect(const ray &r, double t_min, double t_max,
+                   hit_record &rec) const override;
+
+    void surface(const ray &r, hit_record &rec) const override;
+
+    bool bounding_box(double /*time0*/, double /*time1*/,
+                      aabb &output_box) const override {
+        output_box = m_view.box;
+        return triangle_count() > 0;
+    }
+
+    size_t triangle_count() const {
+        return m_view.triangle_count;
+    }
+    size_t vertex_count() const {
+        return m_view.vertex_count;
+    }
+    size_t node_count() const {
+        return m_view.node_count;
+    }
+    // Same meaning as linear_bvh::sah_cost(); 0 without a BVH
+    double sah_cost() const {
+        return m_view.sah_cost;
+    }
+    // Bytes of the vertex, index and node arrays
+    size_t memory_bytes() const;
+
+    const triangle_mesh_view &view() const {
+        return m_view;
+    }
+
+  private:
+    point3 position(uint32_t vertex) const {
+        const vec3 &scale = m_view.scale;
+        const vec3 &offset = m_view.translation;
+        return point3(m_view.x[vertex] * scale.x() + offset.x(),
+                      m_view.y[vertex] * scale.y() + offset.y(),
+                      m_view.z[vertex] * scale.z() + offset.z());
+    }
+    vec3 normal(uint32_t vertex) const {
+        return vec3(m_view.nx[vertex], m_view.ny[vertex], m_view.nz[vertex]);
+    }
+
+    aabb triangle_box(uint32_t triangle) const;
+    bool intersect_triangle(uint32_t triangle, const ray &r, double t_min,
+                            double t_max, double &t, double &bary_u,
+                            double &bary_v) const;
+
+    void point_view_at_data();
+
+    // Owned arrays; empty for a mesh made from a view
+    triangle_mesh_buffers data;
+    aligned_array<linear_bvh_node> nodes;
+
+    shared_ptr<material> mat_ptr;
+    shared_ptr<const void> m_storage;
+    triangle_mesh_view m_view;
+};
+
+inline triangle_mesh::triangle_mesh(triangle_mesh_buffers buffers,
+                                    shared_ptr<material> mat, bool build_bvh,
+                                    const bvh_build_options &options)
+    : data(std::move(buffers)), mat_ptr(std::move(mat)) {
+    const size_t vertices = data.vertex_count();
+    if (data.y.size() != vertices || data.z.size() != vertices ||
+        data.indices.size() % 3 != 0) {
+        throw std::invalid_argument("triangle_mesh: malformed buffers");
+    }
+    for (uint32_t index : data.indices) {
+        if (index >= vertices) {
+            throw std::invalid_argument("triangle_mesh: index out of range");
+        }
+    }
+    const bool has_normals = data.nx.size() == vertices &&
+                             data.ny.size() == vertices &&
+                             data.nz.size() == vertices;
+    const bool has_uvs =
+        data.u.size() == vertices && data.v.size() == vertices;
+    if (!has_normals) {
+        data.nx.clear();
+        data.ny.clear();
+        data.nz.clear();
+    }
+    if (!has_uvs) {
+        data.u.clear();
+        data.v.clear();
+    }
+
+    const size_t triangles = data.triangle_count();
+    if (data.flags.size() != triangles) {
+        data.flags.assign(triangles,
+                          static_cast<uint8_t>(
+                              (has_normals ? kMeshTriangleNormals : 0) |
+                              (has_uvs ? kMeshTriangleUVs : 0)));
+    } else if (!has_normals || !has_uvs) {
+        const uint8_t mask = static_cast<uint8_t>(
+            (has_normals ? kMeshTriangleNormals : 0) |
+            (has_uvs ? kMeshTriangleUVs : 0));
+        for (auto &flag : data.flags) {
+            flag &= mask;
+        }
+    }
+    point_view_at_data();
+    if (triangles == 0) {
+        return;
+    }
+
+    bvh_build_timer timer;
+    std::vector<bvh_build_ref> refs(triangles);
+    for (size_t i = 0; i < triangles; ++i) {
+        bvh_build_ref &ref = refs[i];
+        ref.box = triangle_box(static_cast<uint32_t>(i));
+        ref.centroid = 0.5 * (ref.box.min() + ref.box.max());
+        ref.index = static_cast<uint32_t>(i);
+    }
+    m_view.box = empty_box();
+    for (const auto &ref : refs) {
+        grow(m_view.box, ref.box);
+    }
+    if (!build_bvh) {
+        return;
+    }
+
+    std::vector<linear_bvh_node> built;
+    linear_bvh::build_nodes(refs, options, built);
+    nodes.resize(built.size());
+    std::copy(built.begin(), built.end(), nodes.begin());
+    m_view.sah_cost = linear_bvh::nodes_sah_cost(built, m_view.box, options);
+
+    // Put the triangles in leaf order; refs[i].index is the old position
+    std::vector<uint32_t> indices(data.indices.size());
+    std::vector<uint8_t> flags(triangles);
+    for (size_t i = 0; i < triangles; ++i) {
+        const uint32_t from = refs[i].index;
+        indices[3 * i + 0] = data.indices[3 * from + 0];
+        indices[3 * i + 1] = data.indices[3 * from + 1];
+        indices[3 * i + 2] = data.indices[3 * from + 2];
+        flags[i] = data.flags[from];
+    }
+    data.indices.swap(indices);
+    data.flags.swap(flags);
+    point_view_at_data();
+}
+
+inline void triangle_mesh::point_view_at_data() {
+    m_view.x = data.x.data();
+    m_view.y = data.y.data();
+    m_view.z = data.z.data();
+    m_view.nx = data.nx.empty() ? nullptr : data.nx.data();
+    m_view.ny = data.ny.empty() ? nullptr : data.ny.data();
+    m_view.nz = data.nz.empty() ? nullptr : data.nz.data();
+    m_view.u = data.u.empty() ? nullptr : data.u.data();
+    m_view.v = data.v.empty() ? nullptr : data.v.data();
+    m_view.indices = data.indices.data();
+    m_view.flags = data.flags.data();
+    m_view.nodes = nodes.size() > 0 ? nodes.data() : nullptr;
+    m_view.vertex_count = data.vertex_count();
+    m_view.triangle_count = data.triangle_count();
+    m_view.node_count = nodes.size();
+    m_view.scale = data.scale;
+    m_view.translation = data.translation;
+}
+
+inline size_t triangle_mesh::memory_bytes() const {
+    size_t arrays = 3 + (m_view.nx ? 3 : 0) + (m_view.u ? 2 : 0);
+    return arrays * m_view.vertex_count * sizeof(float) +
+           m_view.triangle_count * (3 * sizeof(uint32_t) + 1) +
+           m_view.node_count * sizeof(linear_bvh_node);
+}
+
+// Same padding as triangle::bounding_box so flat triangles get a volume
+inline aabb triangle_mesh::triangle_box(uint32_t triangle) const {
+    const uint32_t *corner = &m_view.indices[3 * triangle];
+    const point3 p0 = position(corner[0]);
+    const point3 p1 = position(corner[1]);
+    const point3 p2 = position(corner[2]);
+    const double padding = 1e-4;
+    point3 lo, hi;
+    for (int a = 0; a < 3; a++) {
+        lo[a] = fmin(p0[a], fmin(p1[a], p2[a])) - padding;
+        hi[a] = fmax(p0[a], fmax(p1[a], p2[a])) + padding;
+    }
+    return aabb(lo, hi);
+}
+
+inline bool triangle_mesh::hit(const ray &r, double t_min, double t_max,
+                               hit_record &rec) const {
+    if (!intersect(r, t_min, t_max, rec)) {
+        return false;
+    }
+    surface(r, rec);
+    return true;
+}
+
+// Leaves the triangle's index in rec.primitive and its barycentrics in
+// rec.u and rec.v for surface()
+inline bool triangle_mesh::intersect(const ray &r, double t_min,
+                                     double t_max, hit_record &rec) const {
+    double t, bary_u, bary_v;
+    auto record = [&](uint32_t triangle) {
+        rec.t = t;
+        rec.u = bary_u;
+        rec.v = bary_v;
+        rec.primitive = triangle;
+        rec.object = this;
+        rec.transform_count = 0;
+    };
+    if (!m_view.nodes) {
+        // Built without a BVH: test every triangle
+        bool hit_anything = false;
+        for (uint32_t i = 0; i < triangle_count(); ++i) {
+            if (intersect_triangle(i, r, t_min, t_max, t, bary_u, bary_v)) {
+                hit_anything = true;
+                t_max = t;
+                record(i);
+            }
+        }
+        return hit_anything;
+    }
+    return linear_bvh::traverse(
+        m_view.nodes, m_view.node_count, r, t_min, t_max,
+        [&](uint32_t first, uint32_t count, double &t_closest) {
+            bool hit_leaf = false;
+            for (uint32_t i = first; i < first + count; ++i) {
+                if (intersect_triangle(i, r, t_min, t_closest, t, bary_u,
+                                       bary_v)) {
+                    hit_leaf = true;
+                    t_closest = t;
+                    record(i);
+                }
+            }
+            return hit_leaf;
+        });
+}
+
+inline bool triangle_mesh::occluded(const ray &r, double t_min,
+                                    double t_max) const {
+    double t, bary_u, bary_v;
+    if (!m_view.nodes) {
+        for (uint32_t i = 0; i < triangle_count(); ++i) {
+            if (intersect_triangle(i, r, t_min, t_max, t, bary_u, bary_v)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return linear_bvh::traverse<true>(
+        m_view.nodes, m_view.node_count, r, t_min, t_max,
+        [&](uint32_t first, uint32_t count, double & /*t_closest*/) {
+            for (uint32_t i = first; i < first + count; ++i) {
+                if (intersect_triangle(i, r, t_min, t_max, t, bary_u,
+                                       bary_v)) {
+                    return true;
+                }
+            }
+            return false;
+        });
+}
+
+// Möller-Trumbore in double, the same test as triangle
+inline bool triangle_mesh::intersect_triangle(uint32_t triangle,
+                                              const ray &r, double t_min,
+                                              double t_max, double &t,
+                                              double &bary_u,
+                                              double &bary_v) const {
+    const uint32_t *corner = &m_view.indices[3 * triangle];
+    const point3 v0 = position(corner[0]);
+    const vec3 edge1 = position(corner[1]) - v0;
+    const vec3 edge2 = position(corner[2]) - v0;
+
+    return moller_trumbore(v0, edge1, edge2, r, t_min, t_max, t, bary_u,
+                           bary_v);
+}
+
+// Shading as in triangle::surface
+inline void triangle_mesh::surface(const ray &r, hit_record &rec) const {
+    const uint32_t triangle = rec.primitive;
+    const double bary_u = rec.u;
+    const double bary_v = rec.v;
+
+    const uint32_t *corner = &m_view.indices[3 * triangle];
+    const point3 v0 = position(corner[0]);
+    const vec3 edge1 = position(corner[1]) - v0;
+    const vec3 edge2 = position(corner[2]) - v0;
+
+    rec.p = r.at(rec.t);
+    rec.mat_ptr = mat_ptr.get();
+
+    const uint8_t flags = m_view.flags[triangle];
+    double w = 1.0 - bary_u - bary_v;
+    if (flags & kMeshTriangleUVs) {
+        rec.u = w * m_view.u[corner[0]] + bary_u * m_view.u[corner[1]] +
+                bary_v * m_view.u[corner[2]];
+        rec.v = w * m_view.v[corner[0]] + bary_u * m_view.v[corner[1]] +
+                bary_v * m_view.v[corner[2]];
+    }
+
+    vec3 face_normal = unit_vector(cross(edge1, edge2));
+    vec3 shading_normal = face_normal;
+    if (flags & kMeshTriangleNormals) {
+        shading_normal = unit_vector(w * unit_vector(normal(corner[0])) +
+                                     bary_u * unit_vector(normal(corner[1])) +
+                                     bary_v * unit_vector(normal(corner[2])));
+    }
+
+    // front_face from the geometric normal, shading normal flipped to match
+    rec.front_face = dot(r.direction(), face_normal) < 0;
+    rec.normal = rec.front_face ? shading_normal : -shading_normal;
+}
+
+#endif
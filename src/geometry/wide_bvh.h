@@ -0,0 +1,537 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "aligned_array.h"
+#include "bvh_build.h"
+#include "cpu_features.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "linear_bvh.h"
+#include "primitive_store.h"
+#include "ray.h"
+#include "render_stats.h"
+#include "rtweekend.h"
+#include "vec3.h"
+
+// Node of a Width-ary BVH with its children's boxes in structure-of-arrays
+// form, so one SIMD instruction handles the same plane of every child:
+// bounds[0..2][i] is the min x/y/z of child i, bounds[3..5][i] its max.
+// Unused slots have an inverted (empty) box that no ray can hit.
+template <int Width> struct alignas(64) wide_bvh_node {
+    float bounds[6][Width];
+    uint32_t child[Width]; // interior child: node index; leaf: 1st primitive
+    uint8_t count[Width];  // primitives of a leaf child, 0 otherwise
+};
+
+static_assert(sizeof(wide_bvh_node<4>) == 128,
+              "wide_bvh_node<4> should fill two cache lines");
+static_assert(sizeof(wide_bvh_node<8>) == 256,
+              "wide_bvh_node<8> should fill four cache lines");
+
+// Single-precision copy of a ray for the box kernels. slack[a] widens every
+// slab interval on axis a so that rounding the origin and the bounds to
+// float can never make a box the double-precision test would hit look
+// missed.
+struct wide_bvh_ray {
+    float origin[3];
+    float inv_dir[3];
+    float slack[3];
+    int near_plane[3]; // row of bounds holding the entry plane per axis
+    int far_plane[3];
+};
+
+// Relative widening of the float slab test: 8 and 2 float ulps
+constexpr double kWideBvhSlack = 1.0 / (1 << 20);
+constexpr float kWideBvhRounding = 1.0f / (1 << 22);
+
+// Float ends of the ray interval [t_min, t_max], moved outwards by the
+// relative rounding whatever their sign, then rounded down or up, the way
+// linear_bvh rounds its bounds. Infinite ends stay as they are.
+inline float wide_bvh_lower(double t) {
+    const float f = static_cast<float>(t);
+    if (std::isinf(f)) {
+        return f;
+    }
+    return std::nextafter(f - std::abs(f) * kWideBvhRounding,
+                          -std::numeric_limits<float>::infinity());
+}
+
+inline float wide_bvh_upper(double t) {
+    const float f = static_cast<float>(t);
+    if (std::isinf(f)) {
+        return f;
+    }
+    return std::nextafter(f + std::abs(f) * kWideBvhRounding,
+                          std::numeric_limits<float>::infinity());
+}
+
+// Box kernels: test the ray against all children of a node and return a
+// bit mask of the children hit, with their entry distances in t_near.
+template <int Width>
+inline int wide_bvh_intersect_scalar(const wide_bvh_node<Width> &node,
+                                     const wide_bvh_ray &r, float t_min,
+                                     float t_max, float *t_near) {
+    int mask = 0;
+    for (int i = 0; i < Width; i++) {
+        float t0 = t_min;
+        float t1 = t_max;
+        for (int a = 0; a < 3; a++) {
+            float near = (node.bounds[r.near_plane[a]][i] - r.origin[a]) *
+                             r.inv_dir[a] -
+                         r.slack[a];
+            float far = (node.bounds[r.far_plane[a]][i] - r.origin[a]) *
+                            r.inv_dir[a] +
+                        r.slack[a];
+            t0 = near > t0 ? near : t0;
+            t1 = far < t1 ? far : t1;
+        }
+        t_near[i] = t0;
+        mask |= (t0 <= t1) << i;
+    }
+    return mask;
+}
+
+#ifdef RT_X86
+inline int wide_bvh_intersect_sse(const wide_bvh_node<4> &node,
+                                  const wide_bvh_ray &r, float t_min,
+                                  float t_max, float *t_near) {
+    __m128 t0 = _mm_set1_ps(t_min);
+    __m128 t1 = _mm_set1_ps(t_max);
+    for (int a = 0; a < 3; a++) {
+        const __m128 origin = _mm_set1_ps(r.origin[a]);
+        const __m128 inv_dir = _mm_set1_ps(r.inv_dir[a]);
+        const __m128 slack = _mm_set1_ps(r.slack[a]);
+        __m128 near = _mm_sub_ps(
+            _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[r.near_plane[a]]),
+                                  origin),
+                       inv_dir),
+            slack);
+        __m128 far = _mm_add_ps(
+            _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[r.far_plane[a]]),
+                                  origin),
+                       inv_dir),
+            slack);
+        // NaN (0 * inf) in the first operand yields the second, so such an
+        // axis is ignored like in aabb::hit
+        t0 = _mm_max_ps(near, t0);
+        t1 = _mm_min_ps(far, t1);
+    }
+    _mm_storeu_ps(t_near, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+}
+
+RT_TARGET_AVX inline int wide_bvh_intersect_avx(const wide_bvh_node<8> &node,
+                                                const wide_bvh_ray &r,
+                                                float t_min, float t_max,
+                                                float *t_near) {
+    __m256 t0 = _mm256_set1_ps(t_min);
+    __m256 t1 = _mm256_set1_ps(t_max);
+    for (int a = 0; a < 3; a++) {
+        const __m256 origin = _mm256_set1_ps(r.origin[a]);
+        const __m256 inv_dir = _mm256_set1_ps(r.inv_dir[a]);
+        const __m256 slack = _mm256_set1_ps(r.slack[a]);
+        __m256 near = _mm256_sub_ps(
+            _mm256_mul_ps(
+                _mm256_sub_ps(_mm256_load_ps(node.bounds[r.near_plane[a]]),
+                              origin),
+                inv_dir),
+            slack);
+        __m256 far = _mm256_add_ps(
+            _mm256_mul_ps(
+                _mm256_sub_ps(_mm256_load_ps(node.bounds[r.far_plane[a]]),
+                              origin),
+                inv_dir),
+            slack);
+        t0 = _mm256_max_ps(near, t0);
+        t1 = _mm256_min_ps(far, t1);
+    }
+    _mm256_storeu_ps(t_near, t0);
+    return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+}
+#endif
+
+// BVH with Width (4 or 8) children per node, made by collapsing the binary
+// SAH tree of linear_bvh. Each node visit tests all children at once with
+// SSE (4) or AVX (8) when the CPU has it, picked at run time, and falls
+// back to a scalar loop otherwise.
+template <int Width> class wide_bvh : public hittable {
+    static_assert(Width == 4 || Width == 8, "wide_bvh supports 4 or 8");
+
+  public:
+    using node_type = wide_bvh_node<Width>;
+
+    wide_bvh(const hittable_list &list, double time0, double time1,
+             const bvh_build_options &options = default_bvh_build_options())
+        : wide_bvh(list.objects, time0, time1, options) {
+    }
+
+    wide_bvh(const std::vector<shared_ptr<hittable>> &src_objects,
+             double time0, double time1,
+             const bvh_build_options &options = default_bvh_build_options());
+
+    bool hit(const ray &r, double t_min, double t_max,
+             hit_record &rec) const override;
+
+    bool occluded(const ray &r, double t_min, double t_max) const override;
+
+    bool intersect(const ray &r, double t_min, double t_max,
+                   hit_record &rec) const override;
+
+    bool bounding_box(double /*time0*/, double /*time1*/,
+                      aabb &output_box) const override {
+        output_box = box;
+        return !nodes.empty();
+    }
+
+    size_t node_count() const {
+        return nodes.size();
+    }
+    // Same units as linear_bvh::sah_cost; one node visit tests Width boxes
+    double sah_cost() const {
+        return m_sah_cost;
+    }
+    simd_level kernel_level() const {
+        return m_level;
+    }
+
+  private:
+    using intersect_fn = int (*)(const node_type &, const wide_bvh_ray &,
+                                 float, float, float *);
+
+    // Enough for the deepest tree the builder makes
+    static constexpr int kStackSize = kBvhMaxDepth * (Width - 1) + 1;
+
+    uint32_t collapse(const std::vector<linear_bvh_node> &binary,
+                      uint32_t binary_index, std::vector<node_type> &out);
+    void select_kernel();
+    wide_bvh_ray make_ray(const ray &r) const;
+
+    primitive_store primitives; // in leaf order
+    aligned_array<node_type> nodes;
+    aabb box;
+    double m_sah_cost = 0.0;
+    simd_level m_level = simd_level::scalar;
+    intersect_fn m_intersect = &wide_bvh_intersect_scalar<Width>;
+};
+
+template <int Width> void wide_bvh<Width>::select_kernel() {
+    m_level = simd_level::scalar;
+    m_intersect = &wide_bvh_intersect_scalar<Width>;
+}
+
+#ifdef RT_X86
+template <> inline void wide_bvh<4>::select_kernel() {
+    m_level = simd_level::scalar;
+    m_intersect = &wide_bvh_intersect_scalar<4>;
+    if (max_simd_level() >= simd_level::sse) {
+        m_level = simd_level::sse;
+        m_intersect = &wide_bvh_intersect_sse;
+    }
+}
+
+template <> inline void wide_bvh<8>::select_kernel() {
+    m_level = simd_level::scalar;
+    m_intersect = &wide_bvh_intersect_scalar<8>;
+    if (max_simd_level() >= simd_level::avx) {
+        m_level = simd_level::avx;
+        m_intersect = &wide_bvh_intersect_avx;
+    }
+}
+#endif
+
+template <int Width>
+wide_bvh<Width>::wide_bvh(const std::vector<shared_ptr<hittable>> &src_objects,
+                          double time0, double time1,
+                          const bvh_build_options &options) {
+    bvh_build_timer timer;
+    select_kernel();
+    if (src_objects.empty()) {
+        return;
+    }
+
+    std::vector<bvh_build_ref> refs =
+        make_bvh_refs(src_objects, 0, src_objects.size(), time0, time1,
+                      bvh_build_threads(options));
+    std::vector<linear_bvh_node> binary;
+    linear_bvh::build_nodes(refs, options, binary);
+
+    std::vector<shared_ptr<hittable>> ordered;
+    ordered.reserve(refs.size());
+    for (const auto &ref : refs) {
+        ordered.push_back(src_objects[ref.index]);
+    }
+    primitives = primitive_store(std::move(ordered));
+
+    std::vector<node_type> built;
+    built.reserve(binary.size() / (Width - 1) + 1);
+    collapse(binary, 0, built);
+    nodes.resize(built.size());
+    std::copy(built.begin(), built.end(), nodes.begin());
+
+    box = refs[0].box;
+    for (const auto &ref : refs) {
+        box = surrounding_box(box, ref.box);
+    }
+
+    // Every node is entered through its parent's lane for it (the root
+    // always), and every leaf lane that is hit costs its primitive tests
+    double root_area = surface_area(box);
+    auto weight = [root_area](const aabb &b) {
+        return root_area > 0 ? surface_area(b) / root_area : 1.0;
+    };
+    m_sah_cost = options.traversal_cost;
+    for (const auto &node : built) {
+        for (int i = 0; i < Width; i++) {
+            if (node.bounds[0][i] > node.bounds[3][i]) {
+                continue; // empty slot
+            }
+            aabb lane(point3(node.bounds[0][i], node.bounds[1][i],
+                             node.bounds[2][i]),
+                      point3(node.bounds[3][i], node.bounds[4][i],
+                             node.bounds[5][i]));
+            double cost = node.count[i] > 0
+                              ? options.intersection_cost * node.count[i]
+                              : options.traversal_cost;
+            m_sah_cost += cost * weight(lane);
+        }
+    }
+}
+
+// Turns the binary subtree at binary_index into one wide node (plus its
+// descendants) by repeatedly opening the interior child with the largest
+// surface area until Width children are gathered. Returns the node index.
+template <int Width>
+uint32_t wide_bvh<Width>::collapse(const std::vector<linear_bvh_node> &binary,
+                                   uint32_t binary_index,
+                                   std::vector<node_type> &out) {
+    const uint32_t index = static_cast<uint32_t>(out.size());
+    out.emplace_back();
+    {
+        node_type &node = out.back();
+        for (int i = 0; i < Width; i++) {
+            for (int a = 0; a < 3; a++) {
+                node.bounds[a][i] = std::numeric_limits<float>::infinity();
+                node.bounds[a + 3][i] = -std::numeric_limits<float>::infinity();
+            }
+            node.child[i] = 0;
+            node.count[i] = 0;
+        }
+    }
+
+    uint32_t slots[Width];
+    int used = 0;
+    const linear_bvh_node &root = binary[binary_index];
+    if (root.is_leaf()) {
+        slots[used++] = binary_index;
+    } else {
+        slots[used++] = binary_index + 1;
+        slots[used++] = root.offset;
+    }
+    while (used < Width) {
+        int open = -1;
+        double open_area = -1.0;
+        for (int i = 0; i < used; i++) {
+            const linear_bvh_node &candidate = binary[slots[i]];
+            double area = surface_area(candidate.box());
+            if (!candidate.is_leaf() && area > open_area) {
+                open = i;
+                open_area = area;
+            }
+        }
+        if (open < 0) {
+            break;
+        }
+        const uint32_t opened = slots[open];
+        slots[open] = opened + 1;
+        slots[used++] = binary[opened].offset;
+    }
+
+    for (int i = 0; i < used; i++) {
+        const linear_bvh_node &child = binary[slots[i]];
+        uint32_t target;
+        if (child.is_leaf()) {
+            target = child.offset;
+        } else {
+            target = collapse(binary, slots[i], out);
+        }
+        // out may have reallocated, so only index it from here on
+        node_type &node = out[index];
+        for (int a = 0; a < 3; a++) {
+            node.bounds[a][i] = child.bounds_min[a];
+            node.bounds[a + 3][i] = child.bounds_max[a];
+        }
+        node.child[i] = target;
+        node.count[i] = static_cast<uint8_t>(child.primitive_count);
+    }
+    return index;
+}
+
+template <int Width>
+wide_bvh_ray wide_bvh<Width>::make_ray(const ray &r) const {
+    wide_bvh_ray wr;
+    const point3 origin = r.origin();
+    const vec3 inv_dir = r.inv_direction();
+    const int *sign = r.direction_sign();
+    for (int a = 0; a < 3; a++) {
+        wr.origin[a] = static_cast<float>(origin[a]);
+        wr.inv_dir[a] = static_cast<float>(inv_dir[a]);
+        wr.near_plane[a] = sign[a] ? a + 3 : a;
+        wr.far_plane[a] = sign[a] ? a : a + 3;
+
+        // About 8 float ulps of the largest magnitude involved, turned into
+        // a distance along the ray. A ray parallel to the axis gets none.
+        double magnitude = std::fabs(origin[a]) +
+                           std::max(std::fabs(box.min()[a]),
+                                    std::fabs(box.max()[a]));
+        double slack = magnitude * std::fabs(inv_dir[a]) * kWideBvhSlack;
+        wr.slack[a] = std::isfinite(slack) ? static_cast<float>(slack) : 0.0f;
+    }
+    return wr;
+}
+
+template <int Width>
+bool wide_bvh<Width>::hit(const ray &r, double t_min, double t_max,
+                          hit_record &rec) const {
+    if (!intersect(r, t_min, t_max, rec)) {
+        return false;
+    }
+    finish_hit(r, rec);
+    return true;
+}
+
+template <int Width>
+bool wide_bvh<Width>::intersect(const ray &r, double t_min, double t_max,
+                                hit_record &rec) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    const wide_bvh_ray wr = make_ray(r);
+    const float t_min_f = wide_bvh_lower(t_min);
+    float t_max_f = wide_bvh_upper(t_max);
+
+    struct entry {
+        uint32_t node;
+        float t_near;
+    };
+    entry stack[kStackSize];
+    int stack_size = 0;
+    stack[stack_size++] = {0, t_min_f};
+    bool hit_anything = false;
+    long long visited = 0;
+    long long tested = 0;
+
+    while (stack_size > 0) {
+        const entry current = stack[--stack_size];
+        if (current.t_near > t_max_f) {
+            continue; // a closer hit was found after it was pushed
+        }
+        const node_type &node = nodes[current.node];
+        ++visited;
+
+        alignas(32) float t_near[Width];
+        int mask = m_intersect(node, wr, t_min_f, t_max_f, t_near);
+
+        // Children hit, nearest first (insertion sort of at most Width)
+        int order[Width];
+        int hits = 0;
+        while (mask) {
+            int i = 0;
+            while (!(mask & (1 << i))) {
+                ++i;
+            }
+            mask &= mask - 1;
+            int j = hits++;
+            while (j > 0 && t_near[order[j - 1]] > t_near[i]) {
+                order[j] = order[j - 1];
+                --j;
+            }
+            order[j] = i;
+        }
+
+        // Leaves right away, front to back; interior children go on the
+        // stack back to front so the nearest one is popped next
+        for (int k = 0; k < hits; k++) {
+            const int i = order[k];
+            if (node.count[i] == 0 || t_near[i] > t_max_f) {
+                continue;
+            }
+            tested += node.count[i];
+            for (uint32_t p = 0; p < node.count[i]; ++p) {
+                if (primitives.intersect(node.child[i] + p, r, t_min, t_max,
+                                         rec)) {
+                    hit_anything = true;
+                    t_max = rec.t;
+                    t_max_f = wide_bvh_upper(t_max);
+                }
+            }
+        }
+        for (int k = hits - 1; k >= 0; k--) {
+            const int i = order[k];
+            if (node.count[i] == 0) {
+                stack[stack_size++] = {node.child[i], t_near[i]};
+            }
+        }
+    }
+    RT_STAT_ADD(kBvhNodesVisited, visited);
+    RT_STAT_ADD(kPrimitiveTests, tested);
+    return hit_anything;
+}
+
+// Same walk without ordering: children are pushed as they come and the
+// first primitive that blocks the ray ends it
+template <int Width>
+bool wide_bvh<Width>::occluded(const ray &r, double t_min,
+                               double t_max) const {
+    if (nodes.empty()) {
+        return false;
+    }
+
+    const wide_bvh_ray wr = make_ray(r);
+    const float t_min_f = wide_bvh_lower(t_min);
+    const float t_max_f = wide_bvh_upper(t_max);
+
+    uint32_t stack[kStackSize];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    bool blocked = false;
+    long long visited = 0;
+    long long tested = 0;
+
+    while (stack_size > 0 && !blocked) {
+        const node_type &node = nodes[stack[--stack_size]];
+        ++visited;
+
+        alignas(32) float t_near[Width];
+        int mask = m_intersect(node, wr, t_min_f, t_max_f, t_near);
+        while (mask && !blocked) {
+            int i = 0;
+            while (!(mask & (1 << i))) {
+                ++i;
+            }
+            mask &= mask - 1;
+            if (node.count[i] == 0) {
+                stack[stack_size++] = node.child[i];
+                continue;
+            }
+            for (uint32_t p = 0; p < node.count[i]; ++p) {
+                ++tested;
+                if (primitives.occluded(node.child[i] + p, r, t_min, t_max)) {
+                    blocked = true;
+                    break;
+                }
+            }
+        }
+    }
+    RT_STAT_ADD(kBvhNodesVisited, visited);
+    RT_STAT_ADD(kPrimitiveTests, tested);
+    return blocked;
+}
+
+#endif // WIDE_BVH_H
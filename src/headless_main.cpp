@@ -0,0 +1,187 @@
+// Headless batch renderer: renders one scene straight into a RenderBuffer and
+// writes the image as soon as rendering finishes. Never touches SDL, so it
+// runs on machines without a display.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "camera.h"
+#include "cost_heatmap.h"
+#include "process_stats.h"
+#include "render_buffer.h"
+#include "render_job.h"
+#include "renderer.h"
+#include "scenes.h"
+#include "trace.h"
+
+namespace RenderConfig {
+constexpr double kShutterOpen = 0.0;
+constexpr double kShutterClose = 1.0;
+} // namespace RenderConfig
+
+namespace {
+
+enum ExitCode {
+    kExitSuccess = 0,
+    kExitRenderFailed = 1,
+    kExitUsage = 2,
+};
+
+void print_usage(const char *program) {
+    std::cout
+        << "Usage: " << program << " [options]\n"
+        << "  -s, --scene <id>        scene id passed to select_scene "
+           "(default 23)\n"
+        << "  -i, --integrator <id>   0: Path, 1: RR, 2: PBR, 3: NEE, "
+           "4: MIS (default 4)\n"
+        << "      --spp <n>           samples per pixel (default: scene "
+           "setting)\n"
+        << "  -t, --threads <n>       worker threads (default: one per "
+           "CPU the process may use)\n"
+        << "      --affinity <p>      none, compact (fill NUMA nodes in "
+           "turn) or spread (round-robin over nodes) (default none)\n"
+        << "      --tile-size <n>     tile width and height in pixels "
+           "(default 16)\n"
+        << "      --tile-order <o>    scanline, spiral, hilbert or cost "
+           "(slowest tiles of the last pass first; default scanline)\n"
+        << "      --sampler <s>       independent, sobol, halton or "
+           "bluenoise (default independent)\n"
+        << "      --max-depth <n>     maximum path depth (default 50)\n"
+        << "      --progressive <n>   render in passes of n spp\n"
+        << "      --time-budget <s>   stop progressive passes after s "
+           "seconds\n"
+        << "      --adaptive <err>    adaptive sampling to this display "
+           "error (e.g. 0.02)\n"
+        << "      --accel <type>      bvh, linear, bvh4 or bvh8 (default "
+           "linear)\n"
+        << "      --simd <level>      scalar, sse or avx: widest BVH kernels "
+           "(default: best the CPU has)\n"
+        << "      --mesh-cache <on|off> reuse binary <obj>.meshcache files "
+           "(default on)\n"
+        << "      --bvh-bins <n>      SAH bins per axis (default 16)\n"
+        << "      --bvh-leaf-size <n> primitives per linear_bvh leaf "
+           "(default 4)\n"
+        << "      --bvh-threads <n>   BVH build threads (default: all "
+           "hardware threads)\n"
+        << "  -o, --output <file>     .png or .jpg output path (default: "
+           "output/sceneXX_integratorY_<time>.png)\n"
+        << "      --stats <file>      write render statistics as JSON\n"
+        << "      --trace <file>      write a Chrome trace JSON timeline "
+           "(chrome://tracing, ui.perfetto.dev)\n"
+        << "      --cost-heatmap <on|off> also write the time each pixel "
+           "took as <output>_cost.png/.pfm (default off)\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return kExitSuccess;
+        }
+    }
+
+    RenderJob job;
+    std::string error;
+    if (!parse_render_job(argc, argv, job, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        print_usage(argv[0]);
+        return kExitUsage;
+    }
+
+    set_default_accelerator(job.accelerator);
+    default_bvh_build_options() = job.bvh_options;
+    set_max_simd_level(job.simd);
+    mesh_cache_enabled() = job.mesh_cache;
+    if (!job.trace_output.empty()) {
+        start_trace();
+        trace_bind_thread(0, "main");
+    }
+    auto scene_start = std::chrono::steady_clock::now();
+    SceneConfig config = select_scene(job.scene_id);
+    std::chrono::duration<double> scene_time =
+        std::chrono::steady_clock::now() - scene_start;
+    std::cout << "Scene built in " << scene_time.count()
+              << " s (world BVH SAH cost "
+              << accelerator_sah_cost(*config.world) << "), peak memory "
+              << bytes_to_mb(peak_rss_bytes()) << " MB" << std::endl;
+
+    auto cam = make_shared<camera>(
+        config.lookfrom, config.lookat, config.vup, config.vfov,
+        config.aspect_ratio, config.aperture, config.focus_dist,
+        RenderConfig::kShutterOpen, RenderConfig::kShutterClose);
+
+    int width = config.image_width;
+    int height = static_cast<int>(width / config.aspect_ratio);
+    RenderBuffer render_buffer(width, height);
+
+    Renderer renderer;
+    renderer.set_samples(job.samples_per_pixel > 0 ? job.samples_per_pixel
+                                                   : config.samples_per_pixel);
+    renderer.set_threads(job.num_threads);
+    renderer.set_thread_placement(job.thread_placement);
+    renderer.set_tile_size(job.tile_size);
+    renderer.set_tile_order(job.tile_order);
+    renderer.set_sampler(job.sampler);
+    renderer.set_integrator(make_integrator(job.integrator_id));
+    renderer.set_max_depth(job.max_depth);
+    if (job.samples_per_pass > 0 || job.time_budget_seconds > 0) {
+        renderer.set_progressive(std::max(1, job.samples_per_pass),
+                                 job.time_budget_seconds);
+    }
+    if (job.adaptive_threshold > 0) {
+        renderer.set_adaptive(job.adaptive_threshold);
+    }
+    renderer.set_cost_heatmap(job.cost_heatmap);
+
+    renderer.render(config.world, cam, config.background, render_buffer,
+                    config.lights);
+
+    std::string output_file =
+        job.output.empty() ? default_output_path(job) : job.output;
+    if (!save_render_buffer(render_buffer, output_file)) {
+        std::cerr << "Failed to save image to " << output_file << std::endl;
+        return kExitRenderFailed;
+    }
+    std::cout << "Image saved successfully to " << output_file << std::endl;
+
+    if (job.cost_heatmap) {
+        const RenderStats &stats = renderer.stats();
+        std::string heatmap_file = cost_heatmap_path(output_file, ".png");
+        std::string pfm_file = cost_heatmap_path(output_file, ".pfm");
+        if (!save_cost_heatmap(stats, heatmap_file) ||
+            !save_cost_pfm(stats, pfm_file)) {
+            std::cerr << "Failed to save cost heatmap to " << heatmap_file
+                      << std::endl;
+            return kExitRenderFailed;
+        }
+        std::cout << "Cost heatmap saved to " << heatmap_file << " (white = "
+                  << cost_heatmap_scale(stats) * 1e6 << " us per pixel), "
+                  << "nanoseconds in " << pfm_file << std::endl;
+    }
+
+    if (!job.stats_output.empty()) {
+        std::ofstream stats_file(job.stats_output);
+        renderer.stats().write_json(stats_file);
+        if (!stats_file) {
+            std::cerr << "Failed to write " << job.stats_output << std::endl;
+            return kExitRenderFailed;
+        }
+    }
+
+    if (!job.trace_output.empty()) {
+        if (!write_trace(job.trace_output)) {
+            std::cerr << "Failed to write " << job.trace_output << std::endl;
+            return kExitRenderFailed;
+        }
+        std::cout << "Trace saved to " << job.trace_output << std::endl;
+    }
+
+    return kExitSuccess;
+}
@@ -3,6 +3,7 @@
 #define ENVIRONMENT_LIGHT_H
 
 #include "light.h"
+#include "trace.h"
 #include "rtw_stb_image.h"
 #include <algorithm>
 #include <numeric>
@@ -143,9 +144,28 @@ class EnvironmentLight : public Light {
         build_distribution();
     }
 
+    // Map already in memory: width * height RGB triples, rows top to bottom
+    EnvironmentLight(std::vector<float> rgb, int map_width, int map_height)
+        : hdr_data(std::move(rgb)), width(map_width), height(map_height) {
+        if (width <= 0 || height <= 0 ||
+            hdr_data.size() != static_cast<size_t>(width) * height * 3) {
+            std::cerr << "ERROR: Environment map data does not match its "
+                         "size"
+                      << std::endl;
+            hdr_data.clear();
+            width = height = 0;
+            return;
+        }
+        is_light_probe = width == height;
+        build_distribution();
+    }
+
     void build_distribution() {
         if (width == 0 || height == 0)
             return;
+        trace_scope trace("env_map_distribution", "scene",
+                          trace_arg("width", width) + ", " +
+                              trace_arg("height", height));
 
         std::vector<double> luminance_data(width * height);
 
@@ -0,0 +1,474 @@
+// Microbenchmarks: times single intersection and shading kernels on fixed
+// synthetic inputs (camera, bounce and shadow ray streams, random shading
+// points) so kernel changes can be measured without rendering a frame.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "aabb.h"
+#include "bvh.h"
+#include "cpu_features.h"
+#include "environmental_light.h"
+#include "hittable.h"
+#include "linear_bvh.h"
+#include "material.h"
+#include "sphere.h"
+#include "texture.h"
+#include "triangle.h"
+#include "triangle_mesh.h"
+#include "wide_bvh.h"
+
+namespace {
+
+enum ExitCode {
+    kExitSuccess = 0,
+    kExitFailed = 1,
+    kExitUsage = 2,
+};
+
+struct MicrobenchOptions {
+    int rays = 1 << 16;        // per stream
+    int triangles = 100000;    // in the accelerator test soup
+    double min_seconds = 0.25; // per kernel, repeating the whole input
+    uint32_t seed = 1;
+    std::string filter; // only kernels whose name contains this
+    std::string output; // empty: no JSON
+};
+
+// Rays with their own t_max: infinity except for shadow rays
+struct RayStream {
+    std::string name;
+    std::vector<ray> rays;
+    std::vector<double> t_max;
+};
+
+struct MicroResult {
+    std::string kernel;
+    std::string input;
+    long long calls = 0;
+    double seconds = 0.0;
+    double hit_fraction = -1.0; // < 0: not an intersection kernel
+};
+
+constexpr double kTMin = 0.001;
+
+// Pinhole camera at +z looking at the origin; rays in scanline order so
+// neighbours take the same path through a BVH
+RayStream coherent_stream(int count) {
+    RayStream stream{"coherent", {}, {}};
+    const int side = std::max(1, static_cast<int>(std::sqrt(count)));
+    const point3 eye(0, 0, 3);
+    for (int j = 0; j < side; j++) {
+        for (int i = 0; i < side; i++) {
+            point3 target(-1.2 + 2.4 * (i + 0.5) / side,
+                          1.2 - 2.4 * (j + 0.5) / side, 0);
+            stream.rays.emplace_back(eye, unit_vector(target - eye), 0.0);
+            stream.t_max.push_back(infinity);
+        }
+    }
+    return stream;
+}
+
+// Random origins around the scene, uniformly random directions: what
+// diffuse bounces look like to the acceleration structure
+RayStream incoherent_stream(int count) {
+    RayStream stream{"incoherent", {}, {}};
+    for (int i = 0; i < count; i++) {
+        stream.rays.emplace_back(vec3::random(-1.5, 1.5), random_unit_vector(),
+                                 random_double());
+        stream.t_max.push_back(infinity);
+    }
+    return stream;
+}
+
+// Random points towards an area light above the scene, stopping just short
+// of it like the integrators' shadow rays
+RayStream shadow_stream(int count) {
+    RayStream stream{"shadow", {}, {}};
+    for (int i = 0; i < count; i++) {
+        point3 origin = vec3::random(-1.5, 1.5);
+        point3 light(random_double(-0.5, 0.5), 2.0, random_double(-0.5, 0.5));
+        vec3 to_light = light - origin;
+        double dist = to_light.length();
+        stream.rays.emplace_back(origin, to_light / dist, random_double());
+        stream.t_max.push_back(dist - 0.001);
+    }
+    return stream;
+}
+
+// Small random triangles filling [-1, 1]^3
+std::vector<point3> triangle_soup(int count) {
+    std::vector<point3> corners;
+    corners.reserve(3 * static_cast<size_t>(count));
+    for (int i = 0; i < count; i++) {
+        point3 center = vec3::random(-1, 1);
+        for (int k = 0; k < 3; k++) {
+            corners.push_back(center + vec3::random(-0.02, 0.02));
+        }
+    }
+    return corners;
+}
+
+shared_ptr<triangle_mesh> soup_mesh(const std::vector<point3> &corners,
+                                    shared_ptr<material> mat) {
+    triangle_mesh_buffers buffers;
+    for (size_t i = 0; i < corners.size(); i++) {
+        buffers.x.push_back(static_cast<float>(corners[i].x()));
+        buffers.y.push_back(static_cast<float>(corners[i].y()));
+        buffers.z.push_back(static_cast<float>(corners[i].z()));
+        buffers.indices.push_back(static_cast<uint32_t>(i));
+    }
+    return make_shared<triangle_mesh>(std::move(buffers), std::move(mat));
+}
+
+// Sky gradient with a small, very bright sun: a strongly peaked
+// distribution, like the HDR maps the scenes use
+shared_ptr<EnvironmentLight> synthetic_environment(int width, int height) {
+    std::vector<float> rgb(static_cast<size_t>(width) * height * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            double sky = 1.0 - static_cast<double>(y) / height;
+            double dx = (x - 0.3 * width) / width;
+            double dy = (y - 0.25 * height) / height;
+            double sun = dx * dx + dy * dy < 0.0004 ? 1000.0 : 0.0;
+            float *pixel = &rgb[3 * (static_cast<size_t>(y) * width + x)];
+            pixel[0] = static_cast<float>(0.3 * sky + sun);
+            pixel[1] = static_cast<float>(0.5 * sky + sun);
+            pixel[2] = static_cast<float>(0.9 * sky + sun);
+        }
+    }
+    return make_shared<EnvironmentLight>(std::move(rgb), width, height);
+}
+
+// Repeats pass, one run over the whole input that adds to a checksum and
+// returns its number of hits, until min_seconds have passed
+MicroResult time_kernel(const std::string &kernel, const std::string &input,
+                        size_t calls_per_pass, double min_seconds,
+                        const std::function<long long(double &)> &pass,
+                        bool counts_hits = true) {
+    MicroResult result;
+    result.kernel = kernel;
+    result.input = input;
+    double checksum = 0.0;
+    long long hits = pass(checksum); // warm caches and branch predictors
+    hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+    do {
+        hits += pass(checksum);
+        result.calls += static_cast<long long>(calls_per_pass);
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < min_seconds);
+    result.seconds = elapsed.count();
+    if (counts_hits) {
+        result.hit_fraction = static_cast<double>(hits) / result.calls;
+    }
+    // Keeps the work observable; also a quick sanity check between builds
+    if (!std::isfinite(checksum)) {
+        std::cerr << kernel << " (" << input << "): non-finite result"
+                  << std::endl;
+    }
+    return result;
+}
+
+long long trace_stream(const hittable &object, const RayStream &stream,
+                       double &checksum) {
+    long long hits = 0;
+    hit_record rec;
+    for (size_t i = 0; i < stream.rays.size(); i++) {
+        if (object.hit(stream.rays[i], kTMin, stream.t_max[i], rec)) {
+            hits++;
+            checksum += rec.t;
+        }
+    }
+    return hits;
+}
+
+void print_usage(const char *program) {
+    std::cout
+        << "Usage: " << program << " [options]\n"
+        << "      --rays <n>          rays per stream and shading points "
+           "(default 65536)\n"
+        << "      --triangles <n>     triangles for the accelerator tests "
+           "(default 100000)\n"
+        << "      --min-time <s>      minimum time per kernel (default "
+           "0.25)\n"
+        << "      --filter <text>     only kernels whose name contains "
+           "text\n"
+        << "      --seed <n>          input seed (default 1)\n"
+        << "      --simd <level>      scalar, sse or avx (default: best the "
+           "CPU has)\n"
+        << "  -o, --output <file>     also write the results as JSON\n";
+}
+
+bool parse_options(int argc, char *argv[], MicrobenchOptions &options,
+                   simd_level &simd, std::string &error) {
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            error = "missing value for " + flag;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (flag == "--output" || flag == "-o") {
+            options.output = value;
+            continue;
+        }
+        if (flag == "--filter") {
+            options.filter = value;
+            continue;
+        }
+        if (flag == "--simd") {
+            if (!parse_simd_level(value, simd)) {
+                error = "unknown SIMD level '" + value + "'";
+                return false;
+            }
+            continue;
+        }
+
+        char *end = nullptr;
+        if (flag == "--min-time") {
+            double seconds = std::strtod(value.c_str(), &end);
+            if (end == value.c_str() || *end != '\0' || seconds < 0) {
+                error = "invalid value '" + value + "' for " + flag;
+                return false;
+            }
+            options.min_seconds = seconds;
+            continue;
+        }
+
+        long number = std::strtol(value.c_str(), &end, 10);
+        if (end == value.c_str() || *end != '\0' || number < 1) {
+            error = "invalid value '" + value + "' for " + flag;
+            return false;
+        }
+        if (flag == "--rays") {
+            options.rays = static_cast<int>(number);
+        } else if (flag == "--triangles") {
+            options.triangles = static_cast<int>(number);
+        } else if (flag == "--seed") {
+            options.seed = static_cast<uint32_t>(number);
+        } else {
+            error = "unknown option " + flag;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool write_json(const std::string &filename,
+                const std::vector<MicroResult> &results) {
+    std::ofstream out(filename);
+    if (!out) {
+        return false;
+    }
+    out << std::setprecision(9) << "{\n"
+        << "  \"simd\": \"" << simd_level_name(max_simd_level()) << "\",\n"
+        << "  \"kernels\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const MicroResult &r = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {\"kernel\": \"" << r.kernel
+            << "\", \"input\": \"" << r.input << "\", \"calls\": " << r.calls
+            << ", \"seconds\": " << r.seconds
+            << ", \"ns_per_call\": " << r.seconds * 1e9 / r.calls;
+        if (r.hit_fraction >= 0) {
+            out << ", \"hit_fraction\": " << r.hit_fraction;
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return kExitSuccess;
+        }
+    }
+
+    MicrobenchOptions options;
+    simd_level simd = max_simd_level();
+    std::string error;
+    if (!parse_options(argc, argv, options, simd, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        print_usage(argv[0]);
+        return kExitUsage;
+    }
+    set_max_simd_level(simd); // before the wide BVHs pick their kernels
+
+    seed_random(options.seed);
+    const std::vector<RayStream> streams = {coherent_stream(options.rays),
+                                            incoherent_stream(options.rays),
+                                            shadow_stream(options.rays)};
+
+    auto gray = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    std::vector<point3> soup = triangle_soup(options.triangles);
+    std::vector<shared_ptr<hittable>> soup_triangles;
+    for (size_t i = 0; i < soup.size(); i += 3) {
+        soup_triangles.push_back(
+            make_shared<triangle>(soup[i], soup[i + 1], soup[i + 2], gray));
+    }
+
+    // Name, object: single primitives first, then accelerators over the soup
+    std::vector<std::pair<std::string, shared_ptr<hittable>>> objects = {
+        {"sphere::hit", make_shared<sphere>(point3(0, 0, 0), 0.8, gray)},
+        {"triangle::hit",
+         make_shared<triangle>(point3(-1, -1, 0), point3(1, -1, 0),
+                               point3(0, 1, 0), gray)},
+        {"bvh_node::hit", make_shared<bvh_node>(soup_triangles, 0,
+                                                soup_triangles.size(), 0, 1)},
+        {"linear_bvh::hit", make_shared<linear_bvh>(soup_triangles, 0, 1)},
+        {"wide_bvh<4>::hit", make_shared<wide_bvh<4>>(soup_triangles, 0, 1)},
+        {"wide_bvh<8>::hit", make_shared<wide_bvh<8>>(soup_triangles, 0, 1)},
+        {"triangle_mesh::hit", soup_mesh(soup, gray)},
+    };
+
+    auto wanted = [&options](const std::string &kernel) {
+        return options.filter.empty() ||
+               kernel.find(options.filter) != std::string::npos;
+    };
+
+    std::vector<MicroResult> results;
+    auto report = [&results](const MicroResult &r) {
+        std::cout << std::left << std::setw(26) << r.kernel << std::setw(12)
+                  << r.input << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(10)
+                  << r.seconds * 1e9 / r.calls << std::setprecision(2)
+                  << std::setw(12) << r.calls / r.seconds * 1e-6;
+        if (r.hit_fraction >= 0) {
+            std::cout << std::setprecision(1) << std::setw(8)
+                      << 100.0 * r.hit_fraction << "%";
+        }
+        std::cout << std::endl;
+        results.push_back(r);
+    };
+
+    std::cout << std::left << std::setw(26) << "kernel" << std::setw(12)
+              << "input" << std::right << std::setw(10) << "ns/call"
+              << std::setw(12) << "Mcalls/s" << std::setw(9) << "hits"
+              << std::endl;
+
+    const aabb box(point3(-0.8, -0.8, -0.8), point3(0.8, 0.8, 0.8));
+    for (const RayStream &stream : streams) {
+        if (!wanted("aabb::hit")) {
+            break;
+        }
+        report(time_kernel(
+            "aabb::hit", stream.name, stream.rays.size(), options.min_seconds,
+            [&](double &checksum) {
+                long long hits = 0;
+                for (size_t i = 0; i < stream.rays.size(); i++) {
+                    hits += box.hit(stream.rays[i], kTMin, stream.t_max[i]);
+                }
+                checksum += hits;
+                return hits;
+            }));
+    }
+    for (const auto &object : objects) {
+        if (!wanted(object.first)) {
+            continue;
+        }
+        for (const RayStream &stream : streams) {
+            report(time_kernel(object.first, stream.name, stream.rays.size(),
+                               options.min_seconds, [&](double &checksum) {
+                                   return trace_stream(*object.second, stream,
+                                                       checksum);
+                               }));
+        }
+    }
+
+    // Shading points: random normals, outgoing directions on the normal's
+    // side, incoming directions anywhere
+    const size_t points = static_cast<size_t>(options.rays);
+    std::vector<hit_record> records(points);
+    std::vector<vec3> wo(points), wi(points);
+    auto pbr = make_shared<PBRMaterial>(
+        make_shared<solid_color>(0.8, 0.6, 0.4),
+        make_shared<solid_color>(0.3, 0.3, 0.3),
+        make_shared<solid_color>(0.5, 0.5, 0.5));
+    for (size_t i = 0; i < points; i++) {
+        hit_record &rec = records[i];
+        rec.p = vec3::random(-1, 1);
+        rec.normal = random_unit_vector();
+        rec.mat_ptr = pbr.get();
+        rec.t = 1.0;
+        rec.u = random_double();
+        rec.v = random_double();
+        rec.front_face = true;
+        wo[i] = random_unit_vector();
+        if (dot(wo[i], rec.normal) < 0) {
+            wo[i] = -wo[i];
+        }
+        wi[i] = random_unit_vector();
+    }
+    const material &surface = *pbr;
+
+    if (wanted("PBRMaterial::eval")) {
+        report(time_kernel("PBRMaterial::eval", "random", points,
+                           options.min_seconds, [&](double &checksum) {
+                               for (size_t i = 0; i < points; i++) {
+                                   color f =
+                                       surface.eval(records[i], wo[i], wi[i]);
+                                   checksum += f.x() + f.y() + f.z();
+                               }
+                               return 0LL;
+                           },
+                           false));
+    }
+    if (wanted("PBRMaterial::sample")) {
+        report(time_kernel("PBRMaterial::sample", "random", points,
+                           options.min_seconds, [&](double &checksum) {
+                               BSDFSample sampled;
+                               for (size_t i = 0; i < points; i++) {
+                                   if (surface.sample(records[i], wo[i],
+                                                      sampled)) {
+                                       checksum += sampled.pdf;
+                                   }
+                               }
+                               return 0LL;
+                           },
+                           false));
+    }
+    if (wanted("EnvironmentLight::sample")) {
+        auto environment = synthetic_environment(1024, 512);
+        const Light &light = *environment;
+        std::vector<vec2> u(points);
+        for (size_t i = 0; i < points; i++) {
+            u[i] = vec2(random_double(), random_double());
+        }
+        report(time_kernel("EnvironmentLight::sample", "1024x512", points,
+                           options.min_seconds, [&](double &checksum) {
+                               for (size_t i = 0; i < points; i++) {
+                                   LightSample s =
+                                       light.sample(records[i].p, u[i]);
+                                   checksum += s.pdf;
+                               }
+                               return 0LL;
+                           },
+                           false));
+    }
+
+    if (!options.output.empty()) {
+        if (!write_json(options.output, results)) {
+            std::cerr << "Failed to write " << options.output << std::endl;
+            return kExitFailed;
+        }
+        std::cout << "Results written to " << options.output << std::endl;
+    }
+    return kExitSuccess;
+}
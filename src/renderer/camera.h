@@ -29,8 +29,13 @@ class camera {
         time1 = _time1;
     }
 
+    // Ray through (s, t) of the focus plane. Always draws the lens point
+    // (two dimensions) and the time (one), so the dimensions of everything
+    // after the camera do not depend on the aperture.
     ray get_ray(double s, double t) const {
-        vec3 rd = lens_radius * random_in_unit_disk();
+        double lens_u, lens_v;
+        random_double_2d(lens_u, lens_v);
+        vec3 rd = lens_radius * concentric_disk(lens_u, lens_v);
         vec3 offset = u * rd.x() + v * rd.y();
 
         return ray(origin + offset,
@@ -0,0 +1,107 @@
+#ifndef COST_HEATMAP_H
+#define COST_HEATMAP_H
+
+#include "render_stats.h"
+#include "vec3.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "stb_image_write.h"
+
+// Black -> purple -> red -> yellow -> white, t in [0, 1]
+inline color heatmap_color(double t) {
+    static const color kStops[] = {
+        color(0.00, 0.00, 0.02), color(0.34, 0.06, 0.43),
+        color(0.87, 0.32, 0.23), color(0.99, 0.81, 0.15),
+        color(1.00, 1.00, 0.90),
+    };
+    const int last = sizeof(kStops) / sizeof(kStops[0]) - 1;
+    t = clamp(t, 0.0, 1.0) * last;
+    int k = std::min(static_cast<int>(t), last - 1);
+    double f = t - k;
+    return (1 - f) * kStops[k] + f * kStops[k + 1];
+}
+
+// Time of the 99th percentile pixel: the heatmap's white point, so a few
+// outliers do not flatten the rest of the image
+inline double cost_heatmap_scale(const RenderStats &stats) {
+    std::vector<float> sorted(stats.pixel_seconds);
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t k = sorted.size() * 99 / 100;
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return sorted[k];
+}
+
+// False-colour PNG of RenderStats::pixel_seconds, linear from black (free)
+// to white (cost_heatmap_scale and above)
+inline bool save_cost_heatmap(const RenderStats &stats,
+                              const std::string &filename) {
+    const int w = stats.width;
+    const int h = stats.height;
+    if (stats.pixel_seconds.size() != static_cast<size_t>(w) * h || w <= 0) {
+        return false;
+    }
+    const double scale = cost_heatmap_scale(stats);
+    const double inv_scale = scale > 0 ? 1.0 / scale : 0.0;
+
+    std::vector<unsigned char> image_data(static_cast<size_t>(w) * h * 3);
+    unsigned char *out = image_data.data();
+    for (int j = 0; j < h; ++j) {
+        // 翻转Y坐标，与 RenderBuffer 保存的图片一致
+        const float *in =
+            &stats.pixel_seconds[static_cast<size_t>(h - 1 - j) * w];
+        for (int i = 0; i < w; ++i, out += 3) {
+            color c = heatmap_color(in[i] * inv_scale);
+            out[0] = static_cast<unsigned char>(c.x() * 255);
+            out[1] = static_cast<unsigned char>(c.y() * 255);
+            out[2] = static_cast<unsigned char>(c.z() * 255);
+        }
+    }
+    return stbi_write_png(filename.c_str(), w, h, 3, image_data.data(),
+                          w * 3) != 0;
+}
+
+// The raw costs in nanoseconds as a greyscale PFM (little-endian floats,
+// bottom row first, which is already RenderStats' row order)
+inline bool save_cost_pfm(const RenderStats &stats,
+                          const std::string &filename) {
+    const int w = stats.width;
+    const int h = stats.height;
+    if (stats.pixel_seconds.size() != static_cast<size_t>(w) * h || w <= 0) {
+        return false;
+    }
+    FILE *file = std::fopen(filename.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    std::fprintf(file, "Pf\n%d %d\n-1.0\n", w, h);
+    std::vector<float> row(w);
+    bool ok = true;
+    for (int j = 0; j < h && ok; ++j) {
+        const float *in = &stats.pixel_seconds[static_cast<size_t>(j) * w];
+        for (int i = 0; i < w; ++i) {
+            row[i] = in[i] * 1e9f;
+        }
+        ok = std::fwrite(row.data(), sizeof(float), w, file) ==
+             static_cast<size_t>(w);
+    }
+    return std::fclose(file) == 0 && ok;
+}
+
+// "out/image.png" -> "out/image_cost.png"
+inline std::string cost_heatmap_path(const std::string &image_path,
+                                     const std::string &extension) {
+    size_t slash = image_path.find_last_of("/\\");
+    size_t dot = image_path.find_last_of('.');
+    if (dot == std::string::npos ||
+        (slash != std::string::npos && dot < slash)) {
+        dot = image_path.size();
+    }
+    return image_path.substr(0, dot) + "_cost" + extension;
+}
+
+#endif
@@ -32,6 +32,7 @@ class DirectLightIntegrator : public Integrator {
 
         for (int depth = 0; depth < m_max_depth; ++depth) {
             hit_record rec;
+            RT_STAT_ADD(kBounceRays, depth > 0 ? 1 : 0);
             if (!scene.hit(current_ray, 0.001, infinity, rec)) {
                 // Check if there is an environment light in the lights list
                 bool found_env = false;
@@ -85,6 +86,7 @@ class DirectLightIntegrator : public Integrator {
                     std::max({throughput.x(), throughput.y(), throughput.z()});
                 p_survive = clamp(p_survive, 0.05, 0.95);
                 if (random_double() > p_survive) {
+                    RT_STAT_ADD(kRussianRouletteKills, 1);
                     break;
                 }
                 throughput /= p_survive;
@@ -113,10 +115,10 @@ class DirectLightIntegrator : public Integrator {
 
         if (ls.pdf > 0 && ls.Li.length_squared() > 0) {
             ray shadow_ray(rec.p, ls.wi, 0);
-            hit_record shadow_rec;
 
+            RT_STAT_ADD(kShadowRays, 1);
             bool in_shadow =
-                scene.hit(shadow_ray, 0.001, ls.dist - 0.001, shadow_rec);
+                scene.occluded(shadow_ray, 0.001, ls.dist - 0.001);
 
             if (!in_shadow) {
                 color f = rec.mat_ptr->eval(rec, wo, ls.wi);
@@ -4,6 +4,7 @@
 #include "hittable.h"
 #include "light.h"
 #include "ray.h"
+#include "render_stats.h"
 #include "vec3.h"
 
 class Integrator {
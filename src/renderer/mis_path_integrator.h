@@ -34,6 +34,7 @@ class MISPathIntegrator : public Integrator {
         for (int depth = 0; depth < m_max_depth; ++depth) {
             hit_record rec;
 
+            RT_STAT_ADD(kBounceRays, depth > 0 ? 1 : 0);
             if (!scene.hit(current_ray, 0.001, infinity, rec)) {
                 color env_L(0, 0, 0);
                 bool found_env = false;
@@ -140,6 +141,7 @@ class MISPathIntegrator : public Integrator {
                 p_survive = clamp(p_survive, 0.05, 0.95);
 
                 if (random_double() > p_survive) {
+                    RT_STAT_ADD(kRussianRouletteKills, 1);
                     break;
                 }
                 throughput /= p_survive;
@@ -208,9 +210,9 @@ class MISPathIntegrator : public Integrator {
         if (ls.pdf > 0 && ls.Li.length_squared() > 0) {
             // 阴影测试
             ray shadow_ray(rec.p, ls.wi, 0);
-            hit_record shadow_rec;
+            RT_STAT_ADD(kShadowRays, 1);
             bool in_shadow =
-                scene.hit(shadow_ray, 0.001, ls.dist - 0.001, shadow_rec);
+                scene.occluded(shadow_ray, 0.001, ls.dist - 0.001);
 
             if (!in_shadow) {
                 color f = rec.mat_ptr->eval(rec, wo, ls.wi);
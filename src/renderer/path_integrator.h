@@ -27,6 +27,7 @@ class PathIntegrator : public Integrator {
             return color(0, 0, 0);
         }
 
+        RT_STAT_ADD(kBounceRays, depth < m_max_depth ? 1 : 0);
         if (!scene.hit(r, 0.001, infinity, rec)) {
             return background;
         }
@@ -27,6 +27,7 @@ class PBRPathIntegrator : public Integrator {
         for (int depth = 0; depth < m_max_depth; ++depth) {
             hit_record rec;
 
+            RT_STAT_ADD(kBounceRays, depth > 0 ? 1 : 0);
             if (!scene.hit(current_ray, 0.001, infinity, rec)) {
                 L += throughput * background;
                 break;
@@ -64,6 +65,7 @@ class PBRPathIntegrator : public Integrator {
                 p_survive = clamp(p_survive, 0.05, 0.95);
 
                 if (random_double() > p_survive) {
+                    RT_STAT_ADD(kRussianRouletteKills, 1);
                     break;
                 }
                 throughput /= p_survive;
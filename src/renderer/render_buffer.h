@@ -1,27 +1,201 @@
 #ifndef RENDER_BUFFER_H
 #define RENDER_BUFFER_H
 
+#include "aligned_array.h"
 #include "vec3.h"
+#include <algorithm>
 #include <string>
 #include <vector>
 
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+inline double luminance(const color &c) {
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
+// Averages the samples, applies gamma 2 and clamps to [0, 1]
+inline color resolve_color(const color &sample_sum, int samples) {
+    auto scale = 1.0 / samples;
+    auto r = sqrt(scale * sample_sum.x());
+    auto g = sqrt(scale * sample_sum.y());
+    auto b = sqrt(scale * sample_sum.z());
+
+    return color(clamp(r, 0.0, 1.0), clamp(g, 0.0, 1.0), clamp(b, 0.0, 1.0));
+}
+
+// Display framebuffer: one contiguous, cache-line-aligned block of float32
+// RGBA pixels in row-major order. Each row is padded to a whole number of
+// cache lines, so the rows of a 16x16 tile never share a line with another
+// tile and the display/encode paths can walk the memory linearly.
+//
+// Progressive rendering additionally enables an accumulation layer with the
+// same layout, holding the running radiance sum in RGB and the number of
+// samples taken in A. The display pixel is refreshed from it on every
+// accumulate(), so the image stays valid whenever rendering stops.
+// Adaptive sampling also keeps, per pixel, the sum of squared sample
+// luminances (for a running variance) and a converged flag.
 class RenderBuffer {
   public:
+    static constexpr int kChannels = 4;
+    static constexpr int kPixelsPerCacheLine = 64 / (kChannels * sizeof(float));
+
+    // A rectangular window into the buffer. Coordinates are relative to the
+    // tile origin; rows are stride() floats apart.
+    class TileView {
+      public:
+        TileView(float *origin, float *accum_origin, float *moment_origin,
+                 unsigned char *converged_origin, int width, int height,
+                 int stride)
+            : m_origin(origin), m_accum_origin(accum_origin),
+              m_moment_origin(moment_origin),
+              m_converged_origin(converged_origin), m_width(width),
+              m_height(height), m_stride(stride) {
+        }
+
+        float *row(int y) const {
+            return m_origin + static_cast<size_t>(y) * m_stride;
+        }
+        void set_pixel(int x, int y, const color &pixel_color) const {
+            store(row(y) + x * kChannels, pixel_color);
+        }
+
+        // Requires RenderBuffer::enable_accumulation(). luminance_sq_sum is
+        // only recorded when the buffer tracks moments.
+        void accumulate(int x, int y, const color &sample_sum, int samples,
+                        double luminance_sq_sum = 0.0) const {
+            size_t offset = static_cast<size_t>(y) * m_stride + x * kChannels;
+            float *a = m_accum_origin + offset;
+            a[0] += static_cast<float>(sample_sum.x());
+            a[1] += static_cast<float>(sample_sum.y());
+            a[2] += static_cast<float>(sample_sum.z());
+            a[3] += static_cast<float>(samples);
+            store(m_origin + offset, resolve_color(color(a[0], a[1], a[2]),
+                                                   static_cast<int>(a[3])));
+            if (m_moment_origin) {
+                m_moment_origin[pixel_index(x, y)] +=
+                    static_cast<float>(luminance_sq_sum);
+            }
+        }
+        int sample_count(int x, int y) const {
+            return static_cast<int>(
+                m_accum_origin[static_cast<size_t>(y) * m_stride +
+                               x * kChannels + 3]);
+        }
+
+        // Mean luminance of the pixel and the estimated variance of that
+        // mean. Requires moments and at least two samples.
+        void luminance_estimate(int x, int y, double &mean,
+                                double &variance_of_mean) const {
+            const float *a = m_accum_origin +
+                             static_cast<size_t>(y) * m_stride + x * kChannels;
+            double n = a[3];
+            mean = luminance(color(a[0], a[1], a[2])) / n;
+            double mean_sq = m_moment_origin[pixel_index(x, y)] / n;
+            double variance =
+                std::max(0.0, mean_sq - mean * mean) * n / (n - 1.0);
+            variance_of_mean = variance / n;
+        }
+        bool converged(int x, int y) const {
+            return m_converged_origin[pixel_index(x, y)] != 0;
+        }
+        void mark_converged(int x, int y) const {
+            m_converged_origin[pixel_index(x, y)] = 1;
+        }
+
+        int width() const {
+            return m_width;
+        }
+        int height() const {
+            return m_height;
+        }
+        int stride() const {
+            return m_stride;
+        }
+
+      private:
+        size_t pixel_index(int x, int y) const {
+            return static_cast<size_t>(y) * (m_stride / kChannels) + x;
+        }
+
+        float *m_origin;
+        float *m_accum_origin;
+        float *m_moment_origin;
+        unsigned char *m_converged_origin;
+        int m_width;
+        int m_height;
+        int m_stride;
+    };
+
     RenderBuffer(int width, int height) : m_width(width), m_height(height) {
-        m_pixels.resize(height, std::vector<color>(width));
+        int padded_width = (width + kPixelsPerCacheLine - 1) /
+                           kPixelsPerCacheLine * kPixelsPerCacheLine;
+        m_stride = padded_width * kChannels;
+        m_pixels.resize(static_cast<size_t>(m_stride) * height);
     }
 
     void set_pixel(int x, int y, const color &pixel_color) {
         if (x >= 0 && x < m_width && y >= 0 && y < m_height) {
-            m_pixels[y][x] = pixel_color;
+            store(row(y) + x * kChannels, pixel_color);
+        }
+    }
+
+    color get_pixel(int x, int y) const {
+        const float *p = row(y) + x * kChannels;
+        return color(p[0], p[1], p[2]);
+    }
+
+    // Tile covering [x0, x1) x [y0, y1), clipped to the image
+    TileView tile(int x0, int y0, int x1, int y1) {
+        x1 = x1 < m_width ? x1 : m_width;
+        y1 = y1 < m_height ? y1 : m_height;
+        size_t offset = static_cast<size_t>(y0) * m_stride + x0 * kChannels;
+        size_t pixel = offset / kChannels;
+        float *accum = m_accum.empty() ? nullptr : m_accum.data() + offset;
+        float *moments =
+            m_moments.empty() ? nullptr : m_moments.data() + pixel;
+        unsigned char *converged =
+            m_converged.empty() ? nullptr : m_converged.data() + pixel;
+        return TileView(m_pixels.data() + offset, accum, moments, converged,
+                        x1 - x0, y1 - y0, m_stride);
+    }
+
+    // Allocates (or clears) the accumulation layer and blanks the image.
+    // with_moments adds the variance and convergence layers used by
+    // adaptive sampling.
+    void enable_accumulation(bool with_moments = false) {
+        if (m_accum.empty()) {
+            m_accum.resize(m_pixels.size());
+        } else {
+            m_accum.fill(0.0f);
         }
+        if (with_moments) {
+            size_t pixel_count = m_pixels.size() / kChannels;
+            m_moments.resize(pixel_count);
+            m_converged.resize(pixel_count);
+        } else {
+            m_moments.resize(0);
+            m_converged.resize(0);
+        }
+        m_pixels.fill(0.0f);
+    }
+    bool has_accumulation() const {
+        return !m_accum.empty();
+    }
+    // RGB radiance sum and sample count (A) for row y
+    const float *accumulation_row(int y) const {
+        return m_accum.data() + static_cast<size_t>(y) * m_stride;
     }
 
-    const std::vector<std::vector<color>> &get_data() const {
-        return m_pixels;
+    float *row(int y) {
+        return m_pixels.data() + static_cast<size_t>(y) * m_stride;
+    }
+    const float *row(int y) const {
+        return m_pixels.data() + static_cast<size_t>(y) * m_stride;
+    }
+
+    // Row y = 0 is the bottom of the image
+    const float *get_data() const {
+        return m_pixels.data();
     }
 
     int width() const {
@@ -30,57 +204,58 @@ class RenderBuffer {
     int height() const {
         return m_height;
     }
+    // Distance between rows, in floats
+    int stride() const {
+        return m_stride;
+    }
 
     // 保存为PNG图片
     bool save_to_png(const std::string &filename) const {
-        std::vector<unsigned char> image_data(m_width * m_height * 3);
-
-        for (int j = 0; j < m_height; ++j) {
-            for (int i = 0; i < m_width; ++i) {
-                // 翻转Y坐标，使图片正确显示
-                int flipped_j = m_height - 1 - j;
-                int index = (j * m_width + i) * 3;
-                const auto &pixel = m_pixels[flipped_j][i];
-                image_data[index + 0] =
-                    static_cast<unsigned char>(pixel[0] * 255);
-                image_data[index + 1] =
-                    static_cast<unsigned char>(pixel[1] * 255);
-                image_data[index + 2] =
-                    static_cast<unsigned char>(pixel[2] * 255);
-            }
-        }
-
+        std::vector<unsigned char> image_data = to_rgb8();
         return stbi_write_png(filename.c_str(), m_width, m_height, 3,
                               image_data.data(), m_width * 3);
     }
 
     // 保存为JPG图片
     bool save_to_jpg(const std::string &filename, int quality = 90) const {
-        std::vector<unsigned char> image_data(m_width * m_height * 3);
+        std::vector<unsigned char> image_data = to_rgb8();
+        return stbi_write_jpg(filename.c_str(), m_width, m_height, 3,
+                              image_data.data(), quality);
+    }
+
+  private:
+    static void store(float *p, const color &pixel_color) {
+        p[0] = static_cast<float>(pixel_color.x());
+        p[1] = static_cast<float>(pixel_color.y());
+        p[2] = static_cast<float>(pixel_color.z());
+        p[3] = 1.0f;
+    }
+
+    // Tightly packed 8-bit RGB, top row first
+    std::vector<unsigned char> to_rgb8() const {
+        std::vector<unsigned char> image_data(
+            static_cast<size_t>(m_width) * m_height * 3);
+        unsigned char *out = image_data.data();
 
         for (int j = 0; j < m_height; ++j) {
-            for (int i = 0; i < m_width; ++i) {
-                // 翻转Y坐标，使图片正确显示
-                int flipped_j = m_height - 1 - j;
-                int index = (j * m_width + i) * 3;
-                const auto &pixel = m_pixels[flipped_j][i];
-                image_data[index + 0] =
-                    static_cast<unsigned char>(pixel[0] * 255);
-                image_data[index + 1] =
-                    static_cast<unsigned char>(pixel[1] * 255);
-                image_data[index + 2] =
-                    static_cast<unsigned char>(pixel[2] * 255);
+            // 翻转Y坐标，使图片正确显示
+            const float *in = row(m_height - 1 - j);
+            for (int i = 0; i < m_width; ++i, in += kChannels, out += 3) {
+                out[0] = static_cast<unsigned char>(in[0] * 255);
+                out[1] = static_cast<unsigned char>(in[1] * 255);
+                out[2] = static_cast<unsigned char>(in[2] * 255);
             }
         }
-
-        return stbi_write_jpg(filename.c_str(), m_width, m_height, 3,
-                              image_data.data(), quality);
+        return image_data;
     }
 
-  private:
     int m_width;
     int m_height;
-    std::vector<std::vector<color>> m_pixels;
+    int m_stride;
+    aligned_array<float> m_pixels;
+    aligned_array<float> m_accum;
+    aligned_array<float> m_moments;
+    aligned_array<unsigned char> m_converged;
 };
 
-#endif
\ No newline at end of file
+#endif
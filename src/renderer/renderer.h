@@ -6,11 +6,18 @@
 #include "integrator.h"
 #include "material.h"
 #include "render_buffer.h"
+#include "render_stats.h"
 #include "rtweekend.h"
+#include "tile_scheduler.h"
+#include "trace.h"
+#include "worker_pool.h"
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -18,8 +25,39 @@ class Renderer {
   public:
     struct Settings {
         int samples_per_pixel = 10;
+        int num_threads = 0; // 0: one per available CPU
+        int tile_size = 16;  // pixels on a side
+        ThreadPlacement thread_placement = ThreadPlacement::kNone;
+        TileOrder tile_order = TileOrder::kScanline;
+        SamplerType sampler = SamplerType::kIndependent;
+
+        // Progressive mode renders the whole frame in passes of
+        // samples_per_pass spp into the buffer's accumulation layer until
+        // samples_per_pixel is reached, the time budget runs out or
+        // cancel() is called. The image is valid after every pass.
+        bool progressive = false;
+        int samples_per_pass = 1;
+        double time_budget_seconds = 0.0; // 0: no limit
+
+        // Adaptive sampling (implies progressive). Once every pixel of a
+        // tile has adaptive_min_samples, the tile stops receiving samples as
+        // soon as the standard error of its displayed (gamma-corrected)
+        // luminance falls below adaptive_threshold, a fraction of full
+        // white. The samples it no longer needs go to the noisy tiles, up to
+        // adaptive_max_samples per pixel, until the frame has spent
+        // samples_per_pixel samples per pixel on average.
+        bool adaptive = false;
+        double adaptive_threshold = 0.02;
+        int adaptive_min_samples = 16;
+        int adaptive_max_samples = 0; // 0: 8 x samples_per_pixel
+
+        // Time every pixel into RenderStats::pixel_seconds
+        bool cost_heatmap = false;
     };
 
+    // Called after each completed progressive pass with the spp reached
+    using PassCallback = std::function<void(int samples_per_pixel)>;
+
     Renderer() : m_is_rendering(false) {
     }
 
@@ -31,79 +69,159 @@ class Renderer {
                 const color &background, RenderBuffer &target_buffer,
                 const std::vector<shared_ptr<Light>> &lights = {}) {
         m_is_rendering = true;
+        trace_scope trace("render", "render");
 
         auto start_time = std::chrono::high_resolution_clock::now();
+        m_deadline = std::chrono::high_resolution_clock::time_point::max();
+        if (m_settings.time_budget_seconds > 0) {
+            m_deadline =
+                start_time +
+                std::chrono::duration_cast<
+                    std::chrono::high_resolution_clock::duration>(
+                    std::chrono::duration<double>(
+                        m_settings.time_budget_seconds));
+        }
 
         int image_width = target_buffer.width();
         int image_height = target_buffer.height();
 
-        constexpr int TILE_SIZE = 16;
-
-        int tiles_x = (image_width + TILE_SIZE - 1) / TILE_SIZE;
-        int tiles_y = (image_height + TILE_SIZE - 1) / TILE_SIZE;
-        int total_tiles = tiles_x * tiles_y;
-
-        std::atomic<int> next_tile_index(0);
-
-        const int num_threads = std::thread::hardware_concurrency();
-        std::vector<std::thread> threads;
-
-        auto render_worker = [&]() {
-            while (true) {
-                int tile_index = next_tile_index.fetch_add(1);
-                if (tile_index >= total_tiles) {
-                    break;
-                }
-                if (!m_is_rendering) {
-                    break;
-                }
+        const int tile_size = std::max(1, m_settings.tile_size);
+        m_stats = RenderStats();
+        m_stats.threads = worker_count();
+        m_stats.tile_size = tile_size;
+        m_stats.tiles_x = (image_width + tile_size - 1) / tile_size;
+        m_stats.tiles_y = (image_height + tile_size - 1) / tile_size;
+        m_last_tile_seconds.clear();
+        m_stats.tile_seconds.assign(
+            static_cast<size_t>(m_stats.tiles_x) * m_stats.tiles_y, 0.0);
+        m_stats.width = image_width;
+        m_stats.height = image_height;
+        if (m_settings.cost_heatmap) {
+            m_stats.pixel_seconds.assign(
+                static_cast<size_t>(image_width) * image_height, 0.0f);
+        }
+        float *pixel_seconds = m_settings.cost_heatmap
+                                   ? m_stats.pixel_seconds.data()
+                                   : nullptr;
 
-                int tile_y = (tiles_y - 1) - tile_index / tiles_x;
-                int tile_x = tile_index % tiles_x;
-
-                int x_start = tile_x * TILE_SIZE;
-                int y_start = tile_y * TILE_SIZE;
-                int x_end = std::min(x_start + TILE_SIZE, image_width);
-                int y_end = std::min(y_start + TILE_SIZE, image_height);
-
-                for (int j = y_end - 1; j >= y_start; j--) {
-                    for (int i = x_start; i < x_end; i++) {
-                        color pixel_color(0, 0, 0);
-                        for (int s = 0; s < m_settings.samples_per_pixel; ++s) {
-                            auto u = (i + random_double()) / (image_width - 1);
-                            auto v = (j + random_double()) / (image_height - 1);
-                            ray r = cam->get_ray(u, v);
-                            if (m_integrator) {
-                                pixel_color += m_integrator->Li(
-                                    r, *world, background, lights);
-                            }
-                        }
-                        write_color_to_buffer(target_buffer, i, j, pixel_color,
-                                              m_settings.samples_per_pixel);
+        // Sum of the radiance of samples [first_sample, first_sample +
+        // samples); optionally also the sum of squared luminances for the
+        // variance estimate. Every sample draws from its own random key, so
+        // the image does not depend on threads, tile order or passes.
+        auto sample_pixel = [&](int i, int j, int first_sample, int samples,
+                                double *luminance_sq_sum) {
+            std::chrono::steady_clock::time_point pixel_start;
+            if (pixel_seconds) {
+                pixel_start = std::chrono::steady_clock::now();
+            }
+            color pixel_color(0, 0, 0);
+            for (int s = 0; s < samples; ++s) {
+                seed_random_sample(m_seed, i, j, first_sample + s,
+                                   m_settings.sampler);
+                double jitter_u, jitter_v;
+                random_double_2d(jitter_u, jitter_v);
+                auto u = (i + jitter_u) / (image_width - 1);
+                auto v = (j + jitter_v) / (image_height - 1);
+                ray r = cam->get_ray(u, v);
+                if (m_integrator) {
+                    color sample =
+                        m_integrator->Li(r, *world, background, lights);
+                    pixel_color += sample;
+                    if (luminance_sq_sum) {
+                        double y = luminance(sample);
+                        *luminance_sq_sum += y * y;
                     }
                 }
             }
+            RT_STAT_ADD(kCameraRays, samples);
+            if (pixel_seconds) {
+                // Each pixel belongs to one tile, so one worker at a time
+                std::chrono::duration<float> pixel_time =
+                    std::chrono::steady_clock::now() - pixel_start;
+                pixel_seconds[static_cast<size_t>(j) * image_width + i] +=
+                    pixel_time.count();
+            }
+            return pixel_color;
         };
 
-        for (int t = 0; t < num_threads; t++) {
-            threads.emplace_back(render_worker);
-        }
+        int samples_done = 0;
 
-        for (auto &t : threads) {
-            t.join();
+        if (!m_settings.progressive && !m_settings.adaptive) {
+            const int spp = m_settings.samples_per_pixel;
+            render_tiles(target_buffer, [&](const RenderBuffer::TileView &tile,
+                                            int x_start, int y_start) {
+                for (int ty = tile.height() - 1; ty >= 0; ty--) {
+                    for (int tx = 0; tx < tile.width(); tx++) {
+                        color sum = sample_pixel(x_start + tx, y_start + ty,
+                                                 0, spp, nullptr);
+                        tile.set_pixel(tx, ty, resolve_color(sum, spp));
+                    }
+                }
+            });
+            samples_done = spp;
+        } else {
+            samples_done = render_passes(target_buffer, sample_pixel);
         }
-
         auto end_time = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> elapsed = end_time - start_time;
 
         m_is_rendering = false;
-        std::cout << "Rendering finished in " << elapsed.count() << " seconds."
-                  << std::endl;
+        m_stats.render_seconds = elapsed.count();
+        m_stats.samples_per_pixel = samples_done;
+        std::cout << "Rendering finished in " << elapsed.count()
+                  << " seconds (" << samples_done << " spp)." << std::endl;
+#if RT_ENABLE_STATS
+        m_stats.print(std::cout);
+#endif
+    }
+
+    // Counters and tile times of the last render() (see render_stats.h)
+    const RenderStats &stats() const {
+        return m_stats;
     }
 
     void set_samples(int samples) {
         m_settings.samples_per_pixel = samples;
     }
+    void set_threads(int threads) {
+        m_settings.num_threads = threads;
+    }
+    void set_thread_placement(ThreadPlacement placement) {
+        m_settings.thread_placement = placement;
+    }
+    void set_tile_size(int tile_size) {
+        m_settings.tile_size = tile_size;
+    }
+    void set_tile_order(TileOrder order) {
+        m_settings.tile_order = order;
+    }
+    void set_progressive(int samples_per_pass,
+                         double time_budget_seconds = 0.0) {
+        m_settings.progressive = true;
+        m_settings.samples_per_pass = samples_per_pass;
+        m_settings.time_budget_seconds = time_budget_seconds;
+    }
+    void set_adaptive(double threshold, int min_samples = 16,
+                      int max_samples = 0) {
+        m_settings.adaptive = true;
+        m_settings.adaptive_threshold = threshold;
+        m_settings.adaptive_min_samples = min_samples;
+        m_settings.adaptive_max_samples = max_samples;
+    }
+    // Seed of the per-sample random keys: the image only depends on it,
+    // not on the thread count or tile order
+    void set_seed(uint32_t seed) {
+        m_seed = seed;
+    }
+    void set_sampler(SamplerType sampler) {
+        m_settings.sampler = sampler;
+    }
+    void set_cost_heatmap(bool enabled) {
+        m_settings.cost_heatmap = enabled;
+    }
+    void set_pass_callback(PassCallback callback) {
+        m_pass_callback = std::move(callback);
+    }
     void set_max_depth(int depth) {
         if (m_integrator) {
             m_integrator->set_max_depth(depth);
@@ -118,26 +236,208 @@ class Renderer {
     }
 
   private:
+    using TileFunction = std::function<void(const RenderBuffer::TileView &,
+                                            int x_start, int y_start)>;
+
     Settings m_settings;
     std::atomic<bool> m_is_rendering;
+    std::chrono::high_resolution_clock::time_point m_deadline;
+    PassCallback m_pass_callback;
+    uint32_t m_seed = 1;
+    RenderStats m_stats;
+    std::mutex m_stats_mutex;
+    // Time of every tile in the previous pass, for TileOrder::kCostSorted
+    std::vector<double> m_last_tile_seconds;
+    // Render threads, kept from one pass and one render() to the next
+    WorkerPool m_pool;
 
     std::shared_ptr<Integrator> m_integrator;
 
-    void write_color_to_buffer(RenderBuffer &buffer, int x, int y,
-                               color pixel_color, int samples) {
-        auto r = pixel_color.x();
-        auto g = pixel_color.y();
-        auto b = pixel_color.z();
+    int worker_count() const {
+        return m_settings.num_threads > 0 ? m_settings.num_threads
+                                          : available_cpu_count();
+    }
+
+    bool should_continue() const {
+        return m_is_rendering &&
+               std::chrono::high_resolution_clock::now() < m_deadline;
+    }
+
+    // Progressive (and adaptive) rendering: every pass raises the target spp
+    // of all unconverged pixels by samples_per_pass. Returns the average spp
+    // reached.
+    template <typename SamplePixel>
+    int render_passes(RenderBuffer &target_buffer, SamplePixel &sample_pixel) {
+        const bool adaptive = m_settings.adaptive;
+        target_buffer.enable_accumulation(adaptive);
+
+        const long long pixel_count =
+            static_cast<long long>(target_buffer.width()) *
+            target_buffer.height();
+        const long long budget =
+            static_cast<long long>(m_settings.samples_per_pixel) * pixel_count;
+        const int pass_spp = std::max(1, m_settings.samples_per_pass);
+        int max_pixel_spp = m_settings.samples_per_pixel;
+        if (adaptive) {
+            max_pixel_spp = m_settings.adaptive_max_samples > 0
+                                ? m_settings.adaptive_max_samples
+                                : 8 * m_settings.samples_per_pixel;
+        }
+        const int min_samples = std::max(2, m_settings.adaptive_min_samples);
+        const double threshold = m_settings.adaptive_threshold;
+
+        std::atomic<long long> samples_taken(0);
+        int pass_target = 0;
+
+        while (samples_taken < budget && pass_target < max_pixel_spp &&
+               should_continue()) {
+            pass_target = std::min(pass_target + pass_spp, max_pixel_spp);
+            std::atomic<long long> active_pixels(0);
 
-        auto scale = 1.0 / samples;
-        r = sqrt(scale * r);
-        g = sqrt(scale * g);
-        b = sqrt(scale * b);
+            bool complete = render_tiles(
+                target_buffer, [&](const RenderBuffer::TileView &tile,
+                                   int x_start, int y_start) {
+                    long long taken = 0;
+                    long long active = 0;
+                    double display_variance = 0.0;
+                    int estimated = 0;
+                    for (int ty = tile.height() - 1; ty >= 0; ty--) {
+                        for (int tx = 0; tx < tile.width(); tx++) {
+                            if (adaptive && tile.converged(tx, ty)) {
+                                continue;
+                            }
+                            int have = tile.sample_count(tx, ty);
+                            int spp = pass_target - have;
+                            if (spp > 0) {
+                                double luminance_sq_sum = 0.0;
+                                color sum = sample_pixel(
+                                    x_start + tx, y_start + ty, have, spp,
+                                    adaptive ? &luminance_sq_sum : nullptr);
+                                tile.accumulate(tx, ty, sum, spp,
+                                                luminance_sq_sum);
+                                taken += spp;
+                            }
+                            ++active;
+                            if (adaptive && have + spp >= min_samples) {
+                                double mean, variance_of_mean;
+                                tile.luminance_estimate(tx, ty, mean,
+                                                        variance_of_mean);
+                                // Variance after gamma 2 (sqrt), to first
+                                // order, so the error is judged as displayed
+                                display_variance +=
+                                    variance_of_mean / (4.0 * (mean + 1e-4));
+                                ++estimated;
+                            }
+                        }
+                    }
+                    // The whole tile stops once the RMS standard error of
+                    // its displayed pixels falls below the threshold.
+                    // Pooling the estimate over a tile keeps pixels whose
+                    // first samples all missed a rare bright path from
+                    // stopping early with a zero variance.
+                    if (adaptive && estimated == active && estimated > 0) {
+                        double rms_error = sqrt(display_variance / estimated);
+                        if (rms_error < threshold) {
+                            for (int ty = 0; ty < tile.height(); ty++) {
+                                for (int tx = 0; tx < tile.width(); tx++) {
+                                    tile.mark_converged(tx, ty);
+                                }
+                            }
+                            active = 0;
+                        }
+                    }
+                    samples_taken += taken;
+                    active_pixels += active;
+                });
+            if (!complete) {
+                break;
+            }
+            if (m_pass_callback) {
+                m_pass_callback(static_cast<int>(samples_taken / pixel_count));
+            }
+            if (active_pixels == 0) {
+                break;
+            }
+        }
 
-        buffer.set_pixel(
-            x, y,
-            color(clamp(r, 0.0, 1.0), clamp(g, 0.0, 1.0), clamp(b, 0.0, 1.0)));
+        if (adaptive) {
+            std::cout << "Adaptive sampling: " << samples_taken
+                      << " samples, "
+                      << static_cast<double>(samples_taken) / pixel_count
+                      << " spp on average." << std::endl;
+        }
+        return static_cast<int>(samples_taken / pixel_count);
+    }
+
+    // Hands the tiles to a pool of worker threads, in the configured order
+    // with work stealing, until the frame is done. Returns false if it
+    // stopped early because of cancel() or the deadline.
+    bool render_tiles(RenderBuffer &target_buffer,
+                      const TileFunction &render_tile) {
+        const int tile_size = m_stats.tile_size;
+        const int tiles_x = m_stats.tiles_x;
+        const int tiles_y = m_stats.tiles_y;
+        const int total_tiles = tiles_x * tiles_y;
+
+        std::atomic<bool> stopped(false);
+
+        const int num_threads = worker_count();
+        trace_scope trace("tile_pass", "render",
+                          trace_arg("tiles", total_tiles));
+        TileScheduler scheduler(order_tiles(tiles_x, tiles_y,
+                                            m_settings.tile_order,
+                                            m_last_tile_seconds),
+                                num_threads);
+        std::vector<double> pass_seconds(total_tiles, 0.0);
+
+        auto render_worker = [&](int worker) {
+            // Row 0 of the trace is the thread that called render()
+            trace_bind_thread(1 + worker,
+                              "render worker " + std::to_string(worker));
+            thread_render_counters().clear();
+            while (true) {
+                int tile_index = scheduler.next(worker);
+                if (tile_index < 0) {
+                    break;
+                }
+                if (!should_continue()) {
+                    stopped = true;
+                    break;
+                }
+
+                int x_start = tile_index % tiles_x * tile_size;
+                int y_start = tile_index / tiles_x * tile_size;
+                auto tile = target_buffer.tile(x_start, y_start,
+                                               x_start + tile_size,
+                                               y_start + tile_size);
+                auto tile_start = std::chrono::steady_clock::now();
+                render_tile(tile, x_start, y_start);
+                auto tile_end = std::chrono::steady_clock::now();
+                // Build the args only when they will be recorded
+                if (trace_enabled()) {
+                    record_trace_event("tile", "render", tile_start,
+                                       tile_end,
+                                       trace_arg("x", x_start) + ", " +
+                                           trace_arg("y", y_start));
+                }
+                std::chrono::duration<double> tile_time =
+                    tile_end - tile_start;
+                // Only this worker has the tile during this pass
+                pass_seconds[tile_index] = tile_time.count();
+            }
+            std::lock_guard<std::mutex> lock(m_stats_mutex);
+            m_stats.add(thread_render_counters());
+        };
+
+        m_pool.run(num_threads, m_settings.thread_placement, render_worker);
+
+        for (int t = 0; t < total_tiles; t++) {
+            m_stats.tile_seconds[t] += pass_seconds[t];
+        }
+        m_stats.tiles_stolen += scheduler.steals();
+        m_last_tile_seconds.swap(pass_seconds);
+        return !stopped;
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -27,6 +27,7 @@ class RRPathInterator : public Integrator {
         for (int depth = 0; depth < m_max_depth; ++depth) {
             hit_record rec;
 
+            RT_STAT_ADD(kBounceRays, depth > 0 ? 1 : 0);
             if (!scene.hit(current_ray, 0.001, infinity, rec)) {
                 L += throughput * background;
                 break;
@@ -49,6 +50,7 @@ class RRPathInterator : public Integrator {
                 p_survive = clamp(p_survive, 0.005, 0.95);
 
                 if (random_double() > p_survive) {
+                    RT_STAT_ADD(kRussianRouletteKills, 1);
                     break;
                 }
                 throughput /= p_survive;
@@ -0,0 +1,184 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Order in which the tiles of a pass are started
+enum class TileOrder {
+    kScanline,  // rows from the top of the image, left to right
+    kSpiral,    // rings around the image centre, centre first
+    kHilbert,   // along a Hilbert curve: consecutive tiles are neighbours
+    kCostSorted // slowest tile of the previous pass first; spiral before
+};
+
+inline bool parse_tile_order(const std::string &name, TileOrder &order) {
+    if (name == "scanline") {
+        order = TileOrder::kScanline;
+    } else if (name == "spiral") {
+        order = TileOrder::kSpiral;
+    } else if (name == "hilbert") {
+        order = TileOrder::kHilbert;
+    } else if (name == "cost") {
+        order = TileOrder::kCostSorted;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Distance of (x, y) along the Hilbert curve filling an n x n grid, n a
+// power of two
+inline long long hilbert_index(int n, int x, int y) {
+    long long d = 0;
+    for (int s = n / 2; s > 0; s /= 2) {
+        int rx = (x & s) > 0;
+        int ry = (y & s) > 0;
+        d += static_cast<long long>(s) * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+// Tile indices (tile_y * tiles_x + tile_x, tile_y = 0 at buffer row 0) in
+// the given order. costs holds the previous pass's time per tile, by the
+// same index; while it is empty kCostSorted falls back to kSpiral.
+inline std::vector<int> order_tiles(int tiles_x, int tiles_y,
+                                    TileOrder order,
+                                    const std::vector<double> &costs) {
+    const int total = tiles_x * tiles_y;
+    std::vector<int> tiles;
+    tiles.reserve(total);
+    // Buffer row 0 is the bottom of the image, so scanline goes downwards
+    for (int k = 0; k < total; k++) {
+        tiles.push_back(((tiles_y - 1) - k / tiles_x) * tiles_x +
+                        k % tiles_x);
+    }
+    if (order == TileOrder::kScanline) {
+        return tiles;
+    }
+
+    std::vector<double> key(total);
+    if (order == TileOrder::kHilbert) {
+        int n = 1;
+        while (n < std::max(tiles_x, tiles_y)) {
+            n *= 2;
+        }
+        for (int t = 0; t < total; t++) {
+            key[t] = static_cast<double>(
+                hilbert_index(n, t % tiles_x, t / tiles_x));
+        }
+    } else {
+        // Ring first, then the angle within the ring
+        const double cx = 0.5 * (tiles_x - 1);
+        const double cy = 0.5 * (tiles_y - 1);
+        for (int t = 0; t < total; t++) {
+            double dx = t % tiles_x - cx;
+            double dy = t / tiles_x - cy;
+            double ring = std::floor(std::max(std::fabs(dx), std::fabs(dy)));
+            key[t] = ring * 8.0 + (std::atan2(dy, dx) + 4.0);
+        }
+    }
+    std::stable_sort(tiles.begin(), tiles.end(),
+                     [&key](int a, int b) { return key[a] < key[b]; });
+
+    if (order == TileOrder::kCostSorted &&
+        costs.size() == static_cast<size_t>(total)) {
+        std::stable_sort(tiles.begin(), tiles.end(), [&costs](int a, int b) {
+            return costs[a] > costs[b];
+        });
+    }
+    return tiles;
+}
+
+// Hands out the tiles of one pass. Every worker owns a deque; the tiles are
+// dealt round-robin in order, so all workers start at the front of the
+// order. A worker takes from the front of its own deque and, once that is
+// empty, steals from the back of the fullest other one: the tiles the order
+// put last, which are the cheap ones for kCostSorted.
+class TileScheduler {
+  public:
+    TileScheduler(const std::vector<int> &tiles, int workers)
+        : m_workers(std::max(1, workers)),
+          m_queues(new WorkerQueue[m_workers]) {
+        for (size_t k = 0; k < tiles.size(); k++) {
+            WorkerQueue &queue = m_queues[k % m_workers];
+            queue.tiles.push_back(tiles[k]);
+            queue.size.store(static_cast<int>(queue.tiles.size()),
+                             std::memory_order_relaxed);
+        }
+    }
+
+    // Next tile for worker, or -1 once every deque is empty
+    int next(int worker) {
+        int tile = pop(m_queues[worker], false);
+        while (tile < 0) {
+            // No tile is ever added, so a size that reads 0 stays 0
+            int victim = -1;
+            int victim_size = 0;
+            for (int w = 0; w < m_workers; w++) {
+                int size = m_queues[w].size.load(std::memory_order_relaxed);
+                if (w != worker && size > victim_size) {
+                    victim = w;
+                    victim_size = size;
+                }
+            }
+            if (victim < 0) {
+                return -1;
+            }
+            tile = pop(m_queues[victim], true);
+            if (tile >= 0) {
+                m_steals.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        return tile;
+    }
+
+    int steals() const {
+        return m_steals.load();
+    }
+
+  private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<int> tiles;
+        std::atomic<int> size{0};
+        char padding[64]; // keeps neighbouring locks off one cache line
+    };
+
+    static int pop(WorkerQueue &queue, bool back) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tiles.empty()) {
+            return -1;
+        }
+        int tile;
+        if (back) {
+            tile = queue.tiles.back();
+            queue.tiles.pop_back();
+        } else {
+            tile = queue.tiles.front();
+            queue.tiles.pop_front();
+        }
+        queue.size.store(static_cast<int>(queue.tiles.size()),
+                         std::memory_order_relaxed);
+        return tile;
+    }
+
+    int m_workers;
+    std::unique_ptr<WorkerQueue[]> m_queues;
+    std::atomic<int> m_steals{0};
+};
+
+#endif
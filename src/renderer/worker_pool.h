@@ -0,0 +1,167 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu_topology.h"
+
+// Where the pool's threads may run
+enum class ThreadPlacement {
+    kNone,    // wherever the OS schedules them
+    kCompact, // worker i pinned to the i-th available CPU, node by node
+    kSpread,  // round-robin over NUMA nodes, pinned within each node
+};
+
+inline bool parse_thread_placement(const std::string &name,
+                                   ThreadPlacement &placement) {
+    if (name == "none") {
+        placement = ThreadPlacement::kNone;
+    } else if (name == "compact") {
+        placement = ThreadPlacement::kCompact;
+    } else if (name == "spread") {
+        placement = ThreadPlacement::kSpread;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// CPU for each of `workers` threads under placement, -1 for unpinned. More
+// workers than CPUs wrap around.
+inline std::vector<int> thread_cpus(int workers, ThreadPlacement placement) {
+    std::vector<int> cpus(workers, -1);
+    if (placement == ThreadPlacement::kNone) {
+        return cpus;
+    }
+    const std::vector<std::vector<int>> &nodes = cpu_nodes();
+    std::vector<int> order;
+    if (placement == ThreadPlacement::kCompact) {
+        for (const auto &node : nodes) {
+            order.insert(order.end(), node.begin(), node.end());
+        }
+    } else {
+        for (size_t k = 0;; k++) {
+            size_t added = 0;
+            for (const auto &node : nodes) {
+                if (k < node.size()) {
+                    order.push_back(node[k]);
+                    added++;
+                }
+            }
+            if (added == 0) {
+                break;
+            }
+        }
+    }
+    for (int w = 0; w < workers; w++) {
+        cpus[w] = order[w % order.size()];
+    }
+    return cpus;
+}
+
+// Threads that live as long as the pool and run one job at a time, so
+// progressive passes and animation frames do not respawn them. The pool is
+// rebuilt only when the worker count or placement changes.
+class WorkerPool {
+  public:
+    WorkerPool() = default;
+    ~WorkerPool() {
+        stop();
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Runs job(worker) once on each of `workers` threads and returns when
+    // all of them have finished. Not reentrant.
+    void run(int workers, ThreadPlacement placement,
+             const std::function<void(int)> &job) {
+        workers = std::max(1, workers);
+        if (static_cast<int>(m_threads.size()) != workers ||
+            placement != m_placement) {
+            stop();
+            start(workers, placement);
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_job = &job;
+        m_pending = workers;
+        m_generation++;
+        m_wake.notify_all();
+        m_done.wait(lock, [this] { return m_pending == 0; });
+        m_job = nullptr;
+    }
+
+    int size() const {
+        return static_cast<int>(m_threads.size());
+    }
+
+  private:
+    void start(int workers, ThreadPlacement placement) {
+        m_placement = placement;
+        m_stopping = false;
+        std::vector<int> cpus = thread_cpus(workers, placement);
+        // A new thread waits for the first job after this generation, even
+        // if run() posts it before the thread gets to look
+        const unsigned long long generation = m_generation;
+        for (int w = 0; w < workers; w++) {
+            m_threads.emplace_back([this, w, cpu = cpus[w], generation] {
+                if (cpu >= 0) {
+                    pin_current_thread(cpu);
+                }
+                worker_loop(w, generation);
+            });
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for (auto &thread : m_threads) {
+            thread.join();
+        }
+        m_threads.clear();
+    }
+
+    void worker_loop(int worker, unsigned long long seen) {
+        while (true) {
+            const std::function<void(int)> *job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&] {
+                    return m_stopping || m_generation != seen;
+                });
+                if (m_stopping) {
+                    return;
+                }
+                seen = m_generation;
+                job = m_job;
+            }
+            (*job)(worker);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (--m_pending == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    ThreadPlacement m_placement = ThreadPlacement::kNone;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(int)> *m_job = nullptr;
+    unsigned long long m_generation = 0;
+    int m_pending = 0;
+    bool m_stopping = false;
+};
+
+#endif
@@ -1,7 +1,7 @@
 #include "scenes.h"
 #include "aarect.h"
+#include "accelerator.h"
 #include "box.h"
-#include "bvh.h"
 #include "constant_medium.h"
 #include "directional_light.h"
 #include "environmental_light.h"
@@ -12,6 +12,10 @@
 #include "quad_light.h"
 #include "sphere.h"
 #include "spot_light.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <iterator>
 
 shared_ptr<hittable> random_scene() {
     hittable_list world;
@@ -56,7 +60,7 @@ shared_ptr<hittable> random_scene() {
     auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
     world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> example_light_scene() {
@@ -106,7 +110,7 @@ shared_ptr<hittable> example_light_scene() {
     auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
     world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> two_spheres() {
@@ -120,7 +124,7 @@ shared_ptr<hittable> two_spheres() {
     objects.add(make_shared<sphere>(point3(0, 10, 0), 10,
                                     make_shared<lambertian>(checker)));
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 shared_ptr<hittable> two_perlin_spheres() {
@@ -132,7 +136,7 @@ shared_ptr<hittable> two_perlin_spheres() {
     objects.add(make_shared<sphere>(point3(0, 2, 0), 2,
                                     make_shared<lambertian>(pertext)));
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 shared_ptr<hittable> earth() {
@@ -140,7 +144,7 @@ shared_ptr<hittable> earth() {
     auto earth_surface = make_shared<lambertian>(earth_texture);
     auto globe = make_shared<sphere>(point3(0, 0, 0), 2, earth_surface);
 
-    return make_shared<bvh_node>(hittable_list(globe), 0, 1);
+    return make_accelerator(hittable_list(globe), 0, 1);
 }
 
 shared_ptr<hittable> simple_light() {
@@ -154,7 +158,7 @@ shared_ptr<hittable> simple_light() {
     objects.add(make_shared<xy_rect>(3, 5, 1, 3, -2, difflight));
     objects.add(make_shared<sphere>(vec3(0, 7, 0), 2, difflight));
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 shared_ptr<hittable> cornell_box() {
@@ -184,7 +188,7 @@ shared_ptr<hittable> cornell_box() {
     box2 = make_shared<translate>(box2, vec3(130, 0, 65));
     objects.add(box2);
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 shared_ptr<hittable> cornell_smoke() {
@@ -216,7 +220,7 @@ shared_ptr<hittable> cornell_smoke() {
     box2 = make_shared<constant_medium>(box2, 0.01, color(1, 1, 1));
     objects.add(box2);
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 shared_ptr<hittable> final_scene() {
@@ -241,7 +245,7 @@ shared_ptr<hittable> final_scene() {
 
     hittable_list objects;
 
-    objects.add(make_shared<bvh_node>(boxes1, 0, 1));
+    objects.add(make_accelerator(boxes1, 0, 1));
 
     auto light = make_shared<diffuse_light>(color(7, 7, 7));
     objects.add(make_shared<xz_rect>(123, 423, 147, 412, 554, light));
@@ -284,10 +288,10 @@ shared_ptr<hittable> final_scene() {
     }
 
     objects.add(make_shared<translate>(
-        make_shared<rotate_y>(make_shared<bvh_node>(boxes2, 0.0, 1.0), 15),
+        make_shared<rotate_y>(make_accelerator(boxes2, 0.0, 1.0), 15),
         vec3(-100, 270, 395)));
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 shared_ptr<hittable> pbr_test_scene() {
@@ -321,7 +325,7 @@ shared_ptr<hittable> pbr_test_scene() {
         make_shared<PBRMaterial>(blue_albedo, blue_rough, blue_metal);
     world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, blue_mat));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> pbr_spheres_grid() {
@@ -363,7 +367,7 @@ shared_ptr<hittable> pbr_spheres_grid() {
     world.add(make_shared<sphere>(point3(-20, 10, 20), 2, light_mat));
     world.add(make_shared<sphere>(point3(20, 10, 20), 2, light_mat));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> pbr_materials_gallery() {
@@ -428,7 +432,7 @@ shared_ptr<hittable> pbr_materials_gallery() {
     auto light_mat = make_shared<diffuse_light>(color(10, 10, 10));
     world.add(make_shared<sphere>(point3(0, 20, 10), 5, light_mat));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> pbr_reference_scene() {
@@ -515,7 +519,7 @@ shared_ptr<hittable> pbr_reference_scene() {
     world.add(make_shared<sphere>(point3(-20, 10, 20), 2, light_mat));
     world.add(make_shared<sphere>(point3(20, 10, 20), 2, light_mat));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> point_light_scene() {
@@ -543,7 +547,7 @@ shared_ptr<hittable> point_light_scene() {
         make_shared<PBRMaterial>(d_albedo, d_roughness, d_metallic);
     world.add(make_shared<sphere>(point3(3, 1, 0), 1.0, plastic_mat));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> mis_demo() {
@@ -575,7 +579,7 @@ shared_ptr<hittable> mis_demo() {
     auto light_mat = make_shared<diffuse_light>(color(10, 5, 5));
     world.add(make_shared<sphere>(point3(0, 1, -3), 1.0, light_mat));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> mis_comparison_scene() {
@@ -623,7 +627,7 @@ shared_ptr<hittable> mis_comparison_scene() {
     world.add(make_shared<flip_face>(
         make_shared<yz_rect>(3.75, 4.25, 1.75, 2.25, 6, small_light_mat)));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> soft_shadow_demo() {
@@ -654,7 +658,7 @@ shared_ptr<hittable> soft_shadow_demo() {
     world.add(make_shared<flip_face>(
         make_shared<xz_rect>(-2, 2, -2, 2, 8, light_emit)));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> hdr_demo_scene() {
@@ -680,7 +684,7 @@ shared_ptr<hittable> hdr_demo_scene() {
     // auto matte = make_shared<lambertian>(color(0.8, 0.8, 0.8));
     // world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, matte)); // 地面
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> directional_light_scene() {
@@ -714,7 +718,7 @@ shared_ptr<hittable> directional_light_scene() {
     auto material_diffuse = make_shared<lambertian>(color(0.8, 0.5, 0.2));
     objects.add(make_shared<sphere>(point3(0, 5, 0), 1.0, material_diffuse));
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 shared_ptr<hittable> spot_light_scene() {
@@ -732,7 +736,7 @@ shared_ptr<hittable> spot_light_scene() {
     auto blue = make_shared<lambertian>(color(0.1, 0.1, 0.8));
     objects.add(make_shared<box>(point3(1, 0, -1), point3(2, 2, 0), blue));
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 shared_ptr<hittable> environment_light_scene() {
@@ -755,7 +759,7 @@ shared_ptr<hittable> environment_light_scene() {
     objects.add(
         make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 shared_ptr<hittable> quad_light_scene() {
@@ -774,7 +778,7 @@ shared_ptr<hittable> quad_light_scene() {
     auto light_rect = make_shared<xz_rect>(-2, 2, -2, 2, 7, light_mat);
     objects.add(make_shared<flip_face>(light_rect));
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 shared_ptr<hittable> cornell_box_nee() {
@@ -806,7 +810,7 @@ shared_ptr<hittable> cornell_box_nee() {
     box2 = make_shared<translate>(box2, vec3(130, 0, 65));
     objects.add(box2);
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 shared_ptr<hittable> final_scene_nee() {
@@ -831,7 +835,7 @@ shared_ptr<hittable> final_scene_nee() {
 
     hittable_list objects;
 
-    objects.add(make_shared<bvh_node>(boxes1, 0, 1));
+    objects.add(make_accelerator(boxes1, 0, 1));
 
     auto light = make_shared<diffuse_light>(color(7, 7, 7));
     // Flip face so light emits downward
@@ -876,10 +880,10 @@ shared_ptr<hittable> final_scene_nee() {
     }
 
     objects.add(make_shared<translate>(
-        make_shared<rotate_y>(make_shared<bvh_node>(boxes2, 0.0, 1.0), 15),
+        make_shared<rotate_y>(make_accelerator(boxes2, 0.0, 1.0), 15),
         vec3(-100, 270, 395)));
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 // ============================================================================
@@ -942,7 +946,7 @@ shared_ptr<hittable> materials_showcase() {
         world.add(make_shared<sphere>(point3(-3 + i * 1.5, 0.4, 3), 0.4, mat));
     }
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 // Scene 2: Cornell Box Extended - 扩展康奈尔盒
@@ -982,7 +986,7 @@ shared_ptr<hittable> cornell_box_extended() {
                                  make_shared<solid_color>(1.0, 1.0, 1.0));
     objects.add(make_shared<sphere>(point3(350, 380, 350), 50, gold));
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 // Scene 3: Interior Lighting Scene - 室内照明场景
@@ -1053,7 +1057,7 @@ shared_ptr<hittable> interior_lighting_scene() {
     objects.add(make_shared<flip_face>(
         make_shared<xz_rect>(-1, 1, 0, 2, 7.99, ceiling_light)));
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 // Scene 4: Jewelry Display - 珠宝展示台
@@ -1123,7 +1127,7 @@ shared_ptr<hittable> jewelry_display() {
             make_shared<sphere>(point3(-1.5 + i * 0.75, 0.2, 2), 0.2, pearl));
     }
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 // Scene 4 Simplified: Jewelry Display Simplified - 珠宝展示台（简化版）
@@ -1187,7 +1191,7 @@ shared_ptr<hittable> jewelry_display_simplified() {
 
     // 前排小珍珠 -> 已移除
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 // Scene 5: Glass Caustics Scene - 玻璃焦散场景
@@ -1237,7 +1241,7 @@ shared_ptr<hittable> glass_caustics_scene() {
     objects.add(
         make_shared<flip_face>(make_shared<xz_rect>(-3, 3, -3, 3, 10, light)));
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 // Scene 6: PBR Texture Demo - PBR 贴图演示
@@ -1401,7 +1405,7 @@ shared_ptr<hittable> pbr_spheres_grid_lights() {
     world.add(make_shared<flip_face>(
         make_shared<xz_rect>(17, 23, 17, 23, 10, light_mat)));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> multi_light_demo() {
@@ -1458,7 +1462,7 @@ shared_ptr<hittable> multi_light_demo() {
     world.add(
         make_shared<flip_face>(make_shared<xz_rect>(2, 6, 0, 4, 6, light_mat)));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> cmy_shadows_demo() {
@@ -1481,7 +1485,7 @@ shared_ptr<hittable> cmy_shadows_demo() {
     world.add(
         make_shared<box>(point3(-0.1, 0, 1.9), point3(0.1, 0.5, 2.1), rod_mat));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> infinity_mirror_demo() {
@@ -1520,7 +1524,7 @@ shared_ptr<hittable> infinity_mirror_demo() {
     auto chrome = make_shared<metal>(color(0.8, 0.8, 0.8), 0.1);
     world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, chrome));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> mesh_demo_scene() {
@@ -1550,7 +1554,7 @@ shared_ptr<hittable> mesh_demo_scene() {
     }
 
     // World BVH
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> mesh_monkey_scene() {
@@ -1580,7 +1584,7 @@ shared_ptr<hittable> mesh_monkey_scene() {
     }
 
     // World BVH
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> cornell_box_suzanne_fixed() {
@@ -1666,7 +1670,7 @@ shared_ptr<hittable> cornell_box_suzanne_fixed() {
         std::cerr << "failed to load stanford bunny.obj\n";
     }
 
-    return make_shared<bvh_node>(objects, 0, 1);
+    return make_accelerator(objects, 0, 1);
 }
 
 struct ModelFeatureSettings {
@@ -1716,7 +1720,7 @@ model_feature_validation_scene(const ModelFeatureSettings &settings) {
     world.add(make_shared<sphere>(point3(-4.0, 1.25, -2.0), 1.0, mirror));
 
     if (settings.build_bvh) {
-        return make_shared<bvh_node>(world, 0, 1);
+        return make_accelerator(world, 0, 1);
     }
 
     return make_shared<hittable_list>(world);
@@ -1825,7 +1829,7 @@ shared_ptr<hittable> mesh_bvh_stress_scene(bool build_world_bvh,
                                         hemi(n3, f134), hemi(n4, f134), mat));
 
         if (local_build_bvh) {
-            return make_shared<bvh_node>(local, 0.0, 1.0);
+            return make_accelerator(local, 0.0, 1.0);
         }
         return make_shared<hittable_list>(local);
     };
@@ -1862,7 +1866,7 @@ shared_ptr<hittable> mesh_bvh_stress_scene(bool build_world_bvh,
                                   mirror));
 
     if (build_world_bvh) {
-        return make_shared<bvh_node>(world, 0.0, 1.0);
+        return make_accelerator(world, 0.0, 1.0);
     }
     return make_shared<hittable_list>(world);
 }
@@ -1908,7 +1912,7 @@ shared_ptr<hittable> triangle_normal_interp_compare_scene() {
     world.add(
         make_shared<triangle>(a0 + shift, a1 + shift, a2 + shift, tri_mat));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> triangle_vertex_normal_validation_scene() {
@@ -1949,7 +1953,7 @@ shared_ptr<hittable> triangle_vertex_normal_validation_scene() {
     world.add(make_shared<triangle>(v0, v1, v2, n0, n1, n2, tri_mat, vec2(0, 0),
                                     vec2(0, 0), vec2(0, 0), false));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> triangle_hit_validation_scene() {
@@ -1972,7 +1976,7 @@ shared_ptr<hittable> triangle_hit_validation_scene() {
     world.add(make_shared<triangle>(v0, v1, v2, tri_mat));
 
     // Wrap with BVH for consistency (not required, but fine)
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> triangle_occlusion_validation_scene() {
@@ -1996,7 +2000,7 @@ shared_ptr<hittable> triangle_occlusion_validation_scene() {
         make_shared<lambertian>(color(0.85, 0.65, 0.20)); // yellowish
     world.add(make_shared<sphere>(point3(-0.3, 1.6, -0.3), 0.9, occ_mat));
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 shared_ptr<hittable> pyramid_pointlight_compare_scene() {
@@ -2084,10 +2088,11 @@ shared_ptr<hittable> pyramid_pointlight_compare_scene() {
     // Right: flat
     add_tetra(point3(1.8, 0.8, 0.0), 1.15, false);
 
-    return make_shared<bvh_node>(world, 0, 1);
+    return make_accelerator(world, 0, 1);
 }
 
 SceneConfig select_scene(int scene_id) {
+    trace_scope trace("select_scene", "scene", trace_arg("scene", scene_id));
     SceneConfig config;
 
     switch (scene_id) {
@@ -2875,3 +2880,15 @@ SceneConfig select_scene(int scene_id) {
 
     return config;
 }
+
+bool is_valid_scene(int scene_id) {
+    // The cases of select_scene, in order; its default is scene 10
+    static const int kSceneIds[] = {
+        1,  2,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15, 16, 17, 18,
+        19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 30, 31, 32, 33, 34, 37, 38,
+        39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55,
+        56, 57, 58, 59, 60,
+    };
+    return std::binary_search(std::begin(kSceneIds), std::end(kSceneIds),
+                              scene_id);
+}
@@ -24,6 +24,9 @@ struct SceneConfig {
 };
 
 SceneConfig select_scene(int scene_id);
+// True if select_scene has a case for scene_id rather than falling back to
+// its default scene
+bool is_valid_scene(int scene_id);
 // === Triangle intersection validation scenes ===
 shared_ptr<hittable> pyramid_pointlight_compare_scene();
 shared_ptr<hittable> triangle_vertex_normal_validation_scene();